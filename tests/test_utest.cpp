@@ -1,8 +1,49 @@
 #include "utest.h"
 
+#include <map>
+
 using namespace std::literals;
 
 
+namespace formatting {
+
+struct Point
+{
+    int32_t x;
+    int32_t y;
+    bool operator==(const Point&) const = default;
+};
+
+inline void utest_format(std::string& out, const Point& p)
+{
+    out += "Point(" + std::to_string(p.x) + ", " + std::to_string(p.y) + ")";
+}
+
+struct Opaque
+{
+    uint16_t value;
+    bool operator==(const Opaque&) const = default;
+};
+
+enum class Color : uint8_t { red = 1, green = 2 };
+
+}
+
+struct Celsius
+{
+    double degrees;
+};
+
+template <>
+struct ValueFormatter<Celsius>
+{
+    static void format(std::string& out, const Celsius& c)
+    {
+        format_value(out, c.degrees);
+        out += " C";
+    }
+};
+
 MODEL("Barrier")
 {
     ENSURE("0-count barrier wait() with no arrive causes no timeout")
@@ -28,10 +69,88 @@ MODEL("Barrier")
             b.arrive_and_wait();
         );
     };
+
+    ENSURE("A latch stays open once all have arrived")
+    {
+        Barrier b(2);
+        b.arrive();
+        ASSERT_THROW(
+            b.wait(10ms);, std::runtime_error
+        );
+        b.arrive();
+        ASSERT_NO_THROW(
+            b.wait();
+            b.wait();
+        );
+    };
+
+    ENSURE("arrive_and_wait can be used again for every round")
+    {
+        constexpr int32_t threads = 4;
+        constexpr int32_t rounds = 1000;
+        Barrier b(threads);
+        std::atomic<int32_t> arrived = 0;
+        std::atomic<int32_t> mismatches = 0;
+        std::vector<std::thread> workers;
+        for (int32_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&] {
+                for (int32_t round = 1; round <= rounds; ++round) {
+                    arrived += 1;
+                    b.arrive_and_wait(5s);
+                    if (arrived != round * threads) {
+                        mismatches += 1;
+                    }
+                    b.arrive_and_wait(5s);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        ASSERT_EQ(mismatches.load(), 0);
+    };
 }
 
 MODEL("BaseFixture")
 {
+    ENSURE("A sync point can be reused in a loop")
+    {
+        std::atomic<int32_t> done = 0;
+        auto worker = [&] {
+            for (int32_t i = 0; i < 100; ++i) {
+                fixture.sync_point("loop");
+            }
+            done += 1;
+        };
+        std::thread a(worker);
+        std::thread b(worker);
+        a.join();
+        b.join();
+        ASSERT_EQ(done.load(), 2);
+    };
+
+    ENSURE("Sync points with the same name but another count are distinct")
+    {
+        std::atomic<int32_t> released = 0;
+        std::vector<std::thread> threads;
+        for (int32_t i = 0; i < 2; ++i) {
+            threads.emplace_back([&] {
+                fixture.sync_point("point", 3);
+                released += 1;
+            });
+        }
+        // Would be the third arrival if the counts shared a barrier
+        fixture.sync_point("point", 1);
+        std::this_thread::sleep_for(20ms);
+        ASSERT_EQ(released.load(), 0);
+
+        fixture.sync_point("point", 3);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        ASSERT_EQ(released.load(), 2);
+    };
+
     ENSURE("Suite name is properly set in proof's fixture")
     {
         ASSERT_EQ(fixture.utest_suite_name, "BaseFixture");
@@ -66,6 +185,13 @@ MODEL("BaseFixture")
         ASSERT(fixture.time_since_mark("T1") >= 0);
     };
 
+    ENSURE("Time since a mark never set is the maximum")
+    {
+        ASSERT_EQ(fixture.time_since_mark("never"), std::chrono::milliseconds::max().count());
+        ASSERT_EQ(fixture.time_since_mark_ns("never"), std::numeric_limits<int64_t>::max());
+        ASSERT_EQ(fixture.time_between_marks("never", "either"), std::chrono::milliseconds::max().count());
+    };
+
     ENSURE("ASSERT_EQ can compare string literals")
     {
         ASSERT_EQ("test", "test");
@@ -91,3 +217,1844 @@ MODEL("BaseFixture")
         ASSERT_EQ(3.4, 3.4);
     };
 }
+
+MODEL("WorkStealingPool")
+{
+    ENSURE("Every task is executed exactly once across workers")
+    {
+        WorkStealingPool<int32_t> pool(4);
+        std::vector<std::atomic<int32_t>> runs(100);
+        // Put everything on one worker so the others have to steal
+        for (int32_t i = 0; i < 100; ++i) {
+            pool.push(0, i);
+        }
+        pool.run([&](uint32_t, int32_t task) { runs[task] += 1; });
+        ASSERT(std::all_of(runs.begin(), runs.end(), [](auto& r) { return r == 1; }));
+    };
+
+    ENSURE("Job count defaults to a single worker")
+    {
+        char arg0[] = "utest";
+        char* argv[] = {arg0, nullptr};
+        if (!getenv("JOBS")) {
+            ASSERT_EQ(job_count(1, argv), 1u);
+        }
+    };
+
+    ENSURE("Job count is read from -j")
+    {
+        char arg0[] = "utest";
+        char arg1[] = "-j";
+        char arg2[] = "3";
+        char* argv[] = {arg0, arg1, arg2, nullptr};
+        ASSERT_EQ(job_count(3, argv), 3u);
+    };
+
+    ENSURE("Job counts that aren't a number are rejected")
+    {
+        char arg0[] = "utest";
+        char minus_one[] = "--jobs=-1";
+        char text[] = "abc";
+        char jobs[] = "--jobs";
+        char* argv[] = {arg0, minus_one, nullptr, nullptr};
+        ASSERT_THROW(job_count(2, argv);, std::invalid_argument);
+        argv[1] = jobs;
+        argv[2] = text;
+        ASSERT_THROW(job_count(3, argv);, std::invalid_argument);
+        ASSERT_THROW(job_count(2, argv);, std::invalid_argument);
+    };
+
+    ENSURE("Arguments that only start like -j are left alone")
+    {
+        char arg0[] = "utest";
+        char json[] = "-json";
+        char minus_one[] = "-j-1";
+        char bare[] = "-j";
+        char three[] = "-j3";
+        char* argv[] = {arg0, json, minus_one, nullptr, nullptr};
+        ASSERT_EQ(job_count(3, argv), job_count(1, argv));
+        argv[1] = bare;
+        argv[2] = json;
+        uint32_t hardware = std::max(std::thread::hardware_concurrency(), 1u);
+        ASSERT_EQ(job_count(3, argv), hardware);
+        argv[3] = three;
+        ASSERT_EQ(job_count(4, argv), 3u);
+    };
+
+    ENSURE("Job count is capped at a few workers per hardware thread")
+    {
+        char arg0[] = "utest";
+        char arg1[] = "-j1000000000";
+        char* argv[] = {arg0, arg1, nullptr};
+        ASSERT_EQ(job_count(2, argv), 4 * std::max(std::thread::hardware_concurrency(), 1u));
+    };
+}
+
+class CountingFixture : public Fixture
+{
+public:
+    CountingFixture() { alive += 1; }
+    ~CountingFixture() { alive -= 1; }
+
+    static inline int32_t alive = 0;
+};
+
+MODEL("Lazy fixtures")
+{
+    SERIAL_SUITE();
+
+    ENSURE_GIVEN("Fixture is constructed right before its proof runs", CountingFixture)
+    {
+        ASSERT_EQ(CountingFixture::alive, 1);
+    };
+
+    ENSURE_GIVEN("Previous proof's fixture has been destroyed", CountingFixture)
+    {
+        ASSERT_EQ(CountingFixture::alive, 1);
+    };
+}
+
+MODEL("NameFilter")
+{
+    ENSURE("An empty filter matches everything")
+    {
+        ASSERT(NameFilter().matches("anything"));
+        ASSERT(NameFilter("").matches("anything"));
+    };
+
+    ENSURE("Plain patterns match as substrings")
+    {
+        NameFilter filter("arrive");
+        ASSERT(filter.matches("1-count barrier arrive_and_wait"));
+        ASSERT(!filter.matches("1-count barrier wait()"));
+    };
+
+    ENSURE("Globs match anywhere in the name")
+    {
+        NameFilter filter("count*wai?");
+        ASSERT(filter.matches("0-count barrier wait()"));
+        ASSERT(!filter.matches("0-count barrier"));
+    };
+
+    ENSURE("Comma separated inclusions and exclusions are combined")
+    {
+        NameFilter filter("Barrier,Fixture,-Base");
+        ASSERT(filter.matches("Barrier"));
+        ASSERT(filter.matches("Lazy fixtures") == false);
+        ASSERT(filter.matches("CountingFixture"));
+        ASSERT(!filter.matches("BaseFixture"));
+    };
+
+    ENSURE("Regex syntax falls back to std::regex")
+    {
+        NameFilter filter("^ASSERT_EQ.*(ints|floats)$,a{1,2}z");
+        ASSERT(filter.matches("ASSERT_EQ can compare ints"));
+        ASSERT(filter.matches("aaz"));
+        ASSERT(!filter.matches("ASSERT_EQ can compare doubles"));
+    };
+}
+
+MODEL("Benchmarks")
+{
+    ENSURE("percentile uses the nearest rank")
+    {
+        std::vector<double> sorted{1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+        ASSERT_EQ(percentile(sorted, 0.0), 1.0);
+        ASSERT_EQ(percentile(sorted, 0.5), 5.0);
+        ASSERT_EQ(percentile(sorted, 0.99), 10.0);
+        ASSERT_EQ(percentile({}, 0.5), 0.0);
+    };
+
+    ENSURE("measure() scales iterations to the sample time")
+    {
+        auto result = measure([] { do_not_optimize(std::sqrt(2.0)); });
+        ASSERT(result.iterations > 1);
+        ASSERT(result.min_ns <= result.median_ns);
+        ASSERT(result.median_ns <= result.p99_ns);
+    };
+
+    ENSURE("Mann-Whitney tells shifted samples from noise")
+    {
+        std::vector<double> base;
+        std::vector<double> noisy;
+        std::vector<double> slower;
+        for (int32_t i = 0; i < 50; ++i) {
+            base.push_back(100 + i % 7);
+            noisy.push_back(100 + (i * 3) % 7);
+            slower.push_back(120 + i % 7);
+        }
+        ASSERT(mann_whitney_greater(noisy, base) > 0.3);
+        ASSERT(mann_whitney_greater(slower, base) < 1e-6);
+        ASSERT(mann_whitney_greater(base, slower) > 0.99);
+        ASSERT_EQ(mann_whitney_greater(base, {}), 1.0);
+        ASSERT_EQ(mann_whitney_greater({5, 5}, {5, 5}), 1.0);
+    };
+
+    ENSURE("A regression is only reported beyond the threshold")
+    {
+        auto make = [](double ns) {
+            BenchmarkResult result{"S", "b", 100, {}, ns, ns, ns};
+            for (int32_t i = 0; i < 50; ++i) {
+                result.samples.push_back(ns + i % 5);
+            }
+            result.p99_ns = ns + 4;
+            return result;
+        };
+        auto baseline = make(100);
+        ASSERT(!find_regression(make(100), baseline, 0.1, 0.01));
+        ASSERT(!find_regression(make(105), baseline, 0.1, 0.01));
+        ASSERT(!find_regression(make(50), baseline, 0.1, 0.01));
+        auto regression = find_regression(make(130), baseline, 0.1, 0.01);
+        if (ASSERT(regression.has_value())) {
+            ASSERT(regression->starts_with("median 130.0 ns/op vs baseline 100.0 ns/op (+30.0%, p = "));
+        }
+        ASSERT(find_regression(make(105), baseline, 0.01, 0.01));
+
+        auto tail = make(100);
+        tail.p99_ns = 500;
+        tail.samples.back() = 500;
+        ASSERT(!find_regression(tail, baseline, 0.1, 0.01));
+        baseline.samples.clear();
+        ASSERT(find_regression(tail, baseline, 0.1, 0.01)->starts_with("p99 500.0 ns/op vs baseline 104.0 ns/op"));
+    };
+
+    ENSURE("Benchmarks are written with their samples and read back")
+    {
+        auto path = std::filesystem::temp_directory_path() / "utest_baseline_test.json";
+        {
+            ResultsStream stream(path, std::make_unique<JsonReporter>(false));
+            stream.append({"S", "a", "unittest", true, 40, 30, 0});
+            stream.append_benchmark({"S", "b", 1000, {1.5, 2.25, 0.1}, 0.1, 1.5, 2.25});
+            stream.close();
+        }
+        auto benchmarks = read_benchmarks(path);
+        auto history = read_proof_history(path);
+        std::filesystem::remove(path);
+
+        ASSERT_EQ(history.size(), 1u);
+        if (ASSERT_EQ(benchmarks.size(), 1u)) {
+            ASSERT_EQ(benchmarks[0].suite_name, "S");
+            ASSERT_EQ(benchmarks[0].proof_name, "b");
+            ASSERT_EQ(benchmarks[0].iterations, 1000u);
+            ASSERT_EQ(benchmarks[0].median_ns, 1.5);
+            ASSERT(benchmarks[0].samples == (std::vector<double>{1.5, 2.25, 0.1}));
+        }
+    };
+
+    MEASURE("Summing a small vector")
+    {
+        std::vector<int32_t> values{1, 2, 3, 4, 5, 6, 7, 8};
+        int32_t sum = 0;
+        for (auto v : values) {
+            sum += v;
+        }
+        do_not_optimize(sum);
+        ASSERT_EQ(sum, 36);
+    };
+}
+
+MODEL("Proof timing")
+{
+    ENSURE("Thread CPU time advances while the thread is busy")
+    {
+        auto before = thread_cpu_time_ns();
+        auto until = std::chrono::steady_clock::now() + 5ms;
+        while (std::chrono::steady_clock::now() < until) { }
+        ASSERT(thread_cpu_time_ns() > before);
+    };
+
+#if defined(UTEST_POSIX)
+    ENSURE("Proof results record how much the peak RSS grew")
+    {
+        // Past the peak so far, however much of it is still in use
+        const size_t bytes = static_cast<size_t>(max_rss_kb() + 32 * 1024) * 1024;
+        ProofEntry entry{"S", "touching", make_fixture<EmptyFixture>, [bytes](BaseFixture*) {
+            auto memory = std::make_unique<char[]>(bytes);
+            for (size_t i = 0; i < bytes; i += 4096) {
+                memory[i] = 1;
+            }
+            do_not_optimize(memory.get());
+        }};
+        auto outcome = execute_proof(entry);
+        ASSERT(outcome.result.max_rss_delta_kb >= 16 * 1024);
+    };
+#endif
+
+    ENSURE("Performance counters are left out when not available")
+    {
+        PerfCounters perf({"no-such-event", "task-clock"});
+        perf.start();
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < 100000; ++i) {
+            sum += i;
+            do_not_optimize(sum);
+        }
+        auto counts = perf.stop();
+        if (perf.empty()) {
+            ASSERT(counts.empty());
+        }
+        else if (ASSERT_EQ(counts.size(), 1u)) {
+            ASSERT_EQ(counts[0].first, "task-clock");
+            ASSERT(counts[0].second > 0);
+        }
+    };
+
+    ENSURE("Performance counts are written to and read from results")
+    {
+        ProofResult result{"A", "x", "unittest", true, 1, 1, 0};
+        result.perf_counters = {{"cycles", 1200}, {"instructions", 3400}};
+        std::string json;
+        JsonReporter(true).add(json, result, {});
+        ASSERT(json.find("\"perf_cycles\": 1200, \"perf_instructions\": 3400}") != std::string::npos);
+
+        BinaryWriter out;
+        encode_result(out, result, {});
+        BinaryReader in(out.data());
+        ProofResult decoded;
+        std::vector<ProofFailure> failures;
+        decode_result(in, decoded, failures);
+        ASSERT(in.ok());
+        ASSERT(decoded.perf_counters == result.perf_counters);
+
+        BenchmarkResult benchmark{"A", "b", 10, {1.0}, 1, 1, 1, {{"cycles", 2.5}}};
+        json.clear();
+        JsonReporter(true).add_benchmark(json, benchmark);
+        ASSERT(json.find("\"perf_cycles_per_op\": 2.5") != std::string::npos);
+    };
+}
+
+MODEL("Results history")
+{
+    ENSURE("A results file is read back including truncated entries")
+    {
+        auto path = std::filesystem::temp_directory_path() / "utest_history_test.json";
+        {
+            std::ofstream f(path);
+            f << "[\n  {\n    \"type\": \"unittest\",\n    \"name\": \"A::x \\\"y\\\"\",\n"
+              << "    \"passed\": true,\n    \"wall_ns\": 40\n  },\n"
+              << "  {\"name\": \"B::z\", \"passed\": false, \"wall_ns\": 10},\n"
+              << "  {\"name\": \"C::";
+        }
+        auto records = read_results_file(path);
+        std::filesystem::remove(path);
+
+        ASSERT_EQ(records.size(), 2u);
+        ASSERT_EQ(records[0]["name"], "A::x \"y\"");
+        ASSERT_EQ(records[0]["passed"], "true");
+        ASSERT_EQ(records[1]["wall_ns"], "10");
+    };
+
+    ENSURE("Results are streamed as JSON or JSON Lines and read back")
+    {
+        for (auto name : {"utest_stream_test.json", "utest_stream_test.jsonl"}) {
+            auto path = std::filesystem::temp_directory_path() / name;
+            {
+                ResultsStream stream(path);
+                stream.append({"A", "x", "unittest", true, 40, 30, 0});
+                stream.append({"A", "y", "unittest", false, 10, 10, 0});
+                ASSERT_EQ(read_results_file(path).size(), 2u);
+                stream.close();
+            }
+            auto records = read_results_file(path);
+            std::filesystem::remove(path);
+
+            if (ASSERT_EQ(records.size(), 2u)) {
+                ASSERT_EQ(records[0]["name"], "A::x");
+                ASSERT_EQ(records[1]["passed"], "false");
+            }
+        }
+    };
+
+    ENSURE("Names are escaped in JSON and read back unchanged")
+    {
+        std::string json;
+        JsonReporter reporter(true);
+        reporter.add(json, {"A", "say \"hi\"\\\n\x01", "unittest", true, 1, 1, 0}, {});
+        auto path = std::filesystem::temp_directory_path() / "utest_escape_test.jsonl";
+        std::ofstream(path) << json;
+        auto records = read_results_file(path);
+        std::filesystem::remove(path);
+
+        if (ASSERT_EQ(records.size(), 1u)) {
+            ASSERT_EQ(records[0]["name"], "A::say \"hi\"\\\n\x01");
+        }
+    };
+
+    ENSURE("JUnit XML has a testcase per proof with its failures")
+    {
+        std::string xml;
+        JunitReporter reporter;
+        reporter.begin(xml);
+        reporter.add(xml, {"A", "x<y", "unittest", true, 1500000, 0, 0}, {});
+        reporter.add(xml, {"A", "z", "unittest", false, 0, 0, 0},
+                     {ProofFailure{"A", "z", "f.cpp", 7, "a == b", "1", "2", "a"}});
+        reporter.end(xml);
+
+        ASSERT(xml.find("<testcase classname=\"A\" name=\"x&lt;y\" time=\"0.001500\"/>") != std::string::npos);
+        ASSERT(xml.find("<failure message=\"a == b (expected &apos;a&apos; to be 2, actual = 1)\"") != std::string::npos);
+        ASSERT(xml.find(">f.cpp:7</failure>") != std::string::npos);
+        ASSERT(xml.ends_with("</testsuites>\n"));
+    };
+
+    ENSURE("Binary results are size prefixed records after a header")
+    {
+        std::string bin;
+        BinaryReporter reporter;
+        reporter.begin(bin);
+        reporter.add(bin, {"A", "x", "unittest", false, 42, 0, 0},
+                     {ProofFailure{"A", "x", "f.cpp", 7, "a == b", "1", "2", "a"}});
+
+        BinaryReader in(bin);
+        ASSERT_EQ(bin.substr(0, 8), "UTESTRES");
+        in.u64();
+        ASSERT_EQ(in.u32(), BinaryReporter::version);
+        ASSERT_EQ(in.u32(), bin.size() - 16);
+        ProofResult result;
+        std::vector<ProofFailure> failures;
+        decode_result(in, result, failures);
+        ASSERT(in.ok());
+        ASSERT_EQ(result.wall_ns, 42);
+        if (ASSERT_EQ(failures.size(), 1u)) {
+            ASSERT_EQ(failures[0].line_no, 7u);
+        }
+    };
+
+    ENSURE("Proofs are scheduled longest first onto the least loaded worker")
+    {
+        ProofEntry a{"S", "a", {}, {}};
+        ProofEntry b{"S", "b", {}, {}};
+        ProofEntry c{"S", "c", {}, {}};
+        ProofEntry d{"S", "d", {}, {}};
+        ProofHistory history{{"S::a", 10}, {"S::b", 30}, {"S::c", 20}};
+
+        auto bins = partition_longest_first({&a, &b, &c, &d}, history, 2);
+        // d is unknown and estimated at the average of 20
+        ASSERT_EQ(bins.size(), 2u);
+        if (ASSERT_EQ(bins[0].size(), 2u) && ASSERT_EQ(bins[1].size(), 2u)) {
+            ASSERT_EQ(bins[0][0]->proof_name, "b");
+            ASSERT_EQ(bins[0][1]->proof_name, "a");
+            ASSERT_EQ(bins[1][0]->proof_name, "c");
+            ASSERT_EQ(bins[1][1]->proof_name, "d");
+        }
+    };
+
+    ENSURE("Without history proofs are dealt round robin in order")
+    {
+        ProofEntry a{"S", "a", {}, {}};
+        ProofEntry b{"S", "b", {}, {}};
+        ProofEntry c{"S", "c", {}, {}};
+
+        auto bins = partition_longest_first({&a, &b, &c}, {}, 2);
+        if (ASSERT_EQ(bins[0].size(), 2u) && ASSERT_EQ(bins[1].size(), 1u)) {
+            ASSERT_EQ(bins[0][1]->proof_name, "c");
+            ASSERT_EQ(bins[1][0]->proof_name, "b");
+        }
+    };
+
+    ENSURE("Results files are merged into every output format")
+    {
+        auto directory = std::filesystem::temp_directory_path();
+        auto first = directory / "utest_merge_a.json";
+        auto second = directory / "utest_merge_b.jsonl";
+        {
+            ResultsStream a(first);
+            a.append({"A", "x", "unittest", true, 40, 30, 0});
+            a.close();
+            ResultsStream b(second);
+            b.append({"B", "y", "unittest", false, 10, 10, 0});
+            b.append_benchmark({"B", "bench", 10, {1.5, 2.5}, 1.5, 2.0, 2.5});
+            b.close();
+        }
+        auto json = directory / "utest_merged.json";
+        auto xml = directory / "utest_merged.xml";
+        bool merged = merge_results_files(first.string() + "," + second.string(), {json, xml});
+        auto records = read_results_file(json);
+        std::ifstream f(xml);
+        std::string junit((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        bool merged_xml = merge_results_files(xml.string(), {json});
+        for (auto& path : {first, second, json, xml}) {
+            std::filesystem::remove(path);
+        }
+
+        ASSERT(merged);
+        if (ASSERT_EQ(records.size(), 3u)) {
+            ASSERT_EQ(records[0]["name"], "A::x");
+            ASSERT_EQ(records[1]["passed"], "false");
+            ASSERT_EQ(records[2]["samples"], "[1.5, 2.5]");
+        }
+        ASSERT(junit.find("<testcase classname=\"A\" name=\"x\"") != std::string::npos);
+        ASSERT(junit.find("<testcase classname=\"B\" name=\"y\"") != std::string::npos);
+        // Fragments have to be JSON, there is no reading XML back
+        ASSERT(!merged_xml);
+    };
+
+    ENSURE("The failed proofs of a results file are read back with their wall time")
+    {
+        auto path = std::filesystem::temp_directory_path() / "utest_rerun_test.jsonl";
+        {
+            ResultsStream stream(path);
+            stream.append({"A", "x", "unittest", true, 40, 30, 0});
+            stream.append({"A", "y", "unittest", false, 10, 10, 0});
+            stream.close();
+        }
+        auto failed = read_failed_proofs(path);
+        std::filesystem::remove(path);
+
+        ASSERT((failed == ProofHistory{{"A::y", 10}}));
+    };
+
+    ENSURE("RERUN keeps the failed proofs or moves them to the front in order")
+    {
+        ProofEntry a{"S", "a", {}, {}};
+        ProofEntry b{"S", "b", {}, {}};
+        ProofEntry c{"S", "c", {}, {}};
+        ProofHistory failed{{"S::c", 1}, {"S::a", 1}};
+        using Proofs = std::vector<const ProofEntry*>;
+
+        ASSERT((select_rerun({&a, &b, &c}, RerunMode::failed, failed) == Proofs{&a, &c}));
+        ASSERT((select_rerun({&a, &b, &c}, RerunMode::failed_first, failed) == Proofs{&a, &c, &b}));
+        ASSERT((select_rerun({&c, &b, &a}, RerunMode::all, failed) == Proofs{&c, &b, &a}));
+        // Nothing to rerun, so everything runs
+        ASSERT((select_rerun({&a, &b}, RerunMode::failed, {}) == Proofs{&a, &b}));
+        ASSERT((select_rerun({&b}, RerunMode::failed, failed) == Proofs{&b}));
+    };
+}
+
+MODEL("Sharding")
+{
+    ENSURE("Stable hash is FNV-1a")
+    {
+        ASSERT_EQ(stable_hash(""), 14695981039346656037ull);
+        ASSERT_EQ(stable_hash("a"), 0xaf63dc4c8601ec8cull);
+    };
+
+    ENSURE("Every proof lands in exactly one shard")
+    {
+        std::vector<ProofEntry> entries;
+        for (int32_t i = 0; i < 50; ++i) {
+            entries.push_back(ProofEntry{"S", "proof " + std::to_string(i), {}, {}});
+        }
+        std::vector<const ProofEntry*> proofs;
+        for (auto& entry : entries) {
+            proofs.push_back(&entry);
+        }
+
+        for (const auto& history : {ProofHistory{}, ProofHistory{{"S::proof 3", 1000}}}) {
+            std::unordered_map<const ProofEntry*, int32_t> seen;
+            for (uint32_t index = 0; index < 3; ++index) {
+                for (auto proof : select_shard(proofs, {index, 3}, history)) {
+                    seen[proof] += 1;
+                }
+            }
+            ASSERT_EQ(seen.size(), proofs.size());
+            ASSERT(std::all_of(seen.begin(), seen.end(), [](auto& s) { return s.second == 1; }));
+        }
+    };
+
+    ENSURE("A single shard keeps every proof in order")
+    {
+        ProofEntry a{"S", "a", {}, {}};
+        ProofEntry b{"S", "b", {}, {}};
+        auto selected = select_shard({&a, &b}, {}, {});
+        ASSERT((selected == std::vector<const ProofEntry*>{&a, &b}));
+    };
+}
+
+MODEL("TRY_ASSERT")
+{
+    ENSURE("TRY_ASSERT passes once the condition becomes true")
+    {
+        std::atomic<bool> done = false;
+        std::thread worker([&] {
+            std::this_thread::sleep_for(2ms);
+            done = true;
+        });
+        ASSERT(TRY_ASSERT(done.load(), 1000));
+        worker.join();
+    };
+
+    ENSURE("notify() wakes up a sleeping TRY_ASSERT_EQ")
+    {
+        std::atomic<int32_t> value = 0;
+        std::atomic<uint32_t> checks = 0;
+        std::atomic<std::chrono::steady_clock::rep> notified = 0;
+        std::thread worker([&] {
+            // The poll then sleeps 50 us << 12, about 200 ms, after its
+            // 141st check
+            while (checks < BaseFixture::poll_spins + BaseFixture::poll_yields + 13) {
+                std::this_thread::sleep_for(1ms);
+            }
+            std::this_thread::sleep_for(20ms);
+            value = 3;
+            notified = std::chrono::steady_clock::now().time_since_epoch().count();
+            fixture.notify();
+        });
+        ASSERT(fixture.utest_poll([&](bool report) {
+            checks += 1;
+            return fixture.utest_assert_eq(value.load(), 3, __FILE__, __LINE__, "value", "3", report);
+        }, 10000, 10s));
+        auto woken = std::chrono::steady_clock::now().time_since_epoch().count() - notified;
+        ASSERT(std::chrono::steady_clock::duration(woken) < 100ms);
+        worker.join();
+    };
+
+    ENSURE("TRY_ASSERT with no time left makes only the final check")
+    {
+        int32_t checks = 0;
+        ASSERT(fixture.utest_poll([&](bool report) { checks += 1; return report; }, 0));
+        ASSERT_EQ(checks, 1);
+    };
+
+    ENSURE("TRY_ASSERT_NO_THROW and TRY_ASSERT_THROW retry the statement")
+    {
+        int32_t attempts = 0;
+        ASSERT(TRY_ASSERT_NO_THROW(if (++attempts < 3) { throw std::runtime_error("not yet"); }, 1000));
+        ASSERT(TRY_ASSERT_THROW(throw std::runtime_error("always");, std::runtime_error, 1000));
+    };
+}
+
+MODEL("Failure collection")
+{
+    ENSURE("Failures from many threads are all collected by the fixture")
+    {
+        EmptyFixture probe;
+        std::vector<std::thread> threads;
+        for (int32_t t = 0; t < 4; ++t) {
+            threads.emplace_back([&probe] {
+                for (int32_t i = 0; i < 100; ++i) {
+                    probe.utest_assert(false, __FILE__, __LINE__, "false");
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        ASSERT_EQ(probe.utest_failure_count.load(), 400u);
+        ASSERT_EQ(probe.utest_take_failures().size(), 400u);
+        ASSERT(probe.utest_take_failures().empty());
+    };
+
+    ENSURE("Failures are returned oldest first")
+    {
+        EmptyFixture probe;
+        probe.utest_assert(false, "first.cpp", 1, "a");
+        probe.utest_assert(false, "second.cpp", 2, "b");
+        auto failures = probe.utest_take_failures();
+        if (ASSERT_EQ(failures.size(), 2u)) {
+            ASSERT_EQ(failures[0].filename, "first.cpp");
+            ASSERT_EQ(failures[1].line_no, 2u);
+        }
+    };
+}
+
+MODEL("Assertions")
+{
+    ENSURE("ASSERT_EQ compares strings with long literals without copying them")
+    {
+        std::string text = "a string that is longer than the small string buffer";
+        ASSERT_EQ(text, "a string that is longer than the small string buffer");
+        ASSERT_EQ(std::u8string(u8"test"), u8"test");
+    };
+
+    ENSURE("A passing assertion reports nothing")
+    {
+        EmptyFixture probe;
+        probe.utest_assert(true, __FILE__, __LINE__, "true");
+        probe.utest_assert_eq(1, 1, __FILE__, __LINE__, "1", "1");
+        probe.utest_assert_no_throw([] {}, __FILE__, __LINE__);
+        ASSERT(probe.utest_take_failures().empty());
+    };
+
+    ENSURE("A failed ASSERT_EQ materializes the expression text")
+    {
+        EmptyFixture probe;
+        probe.utest_assert_eq(1, 2, "file.cpp", 7, "one", "two");
+        auto failures = probe.utest_take_failures();
+        if (ASSERT_EQ(failures.size(), 1u)) {
+            ASSERT_EQ(failures[0].test, "one == two");
+            ASSERT_EQ(failures[0].actual, "1");
+            ASSERT_EQ(failures[0].expected, "2");
+        }
+    };
+}
+
+MODEL("Process isolation")
+{
+    ENSURE("Binary encoding round-trips a proof outcome")
+    {
+        ProofOutcome outcome{{"S", "p", "unittest", false, 10, 20, -3}, {}, {}};
+        outcome.failures.push_back(ProofFailure{"S", "p", "f.cpp", 4, "a == b", "1", "2", "a"});
+        std::vector<BenchmarkResult> benchmarks{{"S", "b", 100, {1.5, 2.5}, 1.5, 1.5, 2.5}};
+        std::vector<StressResult> stress{{"S", "c", {10, 20}, {100, 200}}};
+
+        BinaryWriter out;
+        encode_outcome(out, outcome, benchmarks, stress);
+        BinaryReader in(out.data());
+        ProofOutcome decoded;
+        std::vector<BenchmarkResult> decoded_benchmarks;
+        std::vector<StressResult> decoded_stress;
+
+        ASSERT(decode_outcome(in, decoded, decoded_benchmarks, decoded_stress));
+        ASSERT_EQ(decoded.result.proof_name, "p");
+        ASSERT_EQ(decoded.result.max_rss_delta_kb, -3);
+        if (ASSERT_EQ(decoded.failures.size(), 1u)) {
+            ASSERT_EQ(decoded.failures[0].line_no, 4u);
+            ASSERT_EQ(decoded.failures[0].test, "a == b");
+        }
+        if (ASSERT_EQ(decoded_benchmarks.size(), 1u)) {
+            ASSERT_EQ(decoded_benchmarks[0].samples.size(), 2u);
+            ASSERT_EQ(decoded_benchmarks[0].p99_ns, 2.5);
+        }
+        if (ASSERT_EQ(decoded_stress.size(), 1u)) {
+            ASSERT(decoded_stress[0].iterations == (std::vector<uint64_t>{10, 20}));
+            ASSERT_EQ(decoded_stress[0].wall_ns[1], 200);
+        }
+    };
+
+    ENSURE("Reading a truncated encoding fails")
+    {
+        BinaryWriter out;
+        out.str("truncated");
+        BinaryReader in(std::string_view(out.data()).substr(0, 6));
+        in.str();
+        ASSERT(!in.ok());
+    };
+
+#if defined(UTEST_POSIX)
+    ENSURE("Crash signals are reported by name")
+    {
+        ASSERT_EQ(signal_name(SIGSEGV), "SIGSEGV");
+        ASSERT_EQ(signal_name(SIGABRT), "SIGABRT");
+    };
+#endif
+}
+
+#if defined(UTEST_POSIX)
+// Runs run() in a forked child whose output is discarded and whose results
+// go to path, and returns the child's exit status
+template <typename F>
+int run_forked(const std::filesystem::path& path, F&& run)
+{
+    std::cout.flush();
+    std::fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (!std::freopen("/dev/null", "w", stdout)) {
+            std::_Exit(3);
+        }
+        // The results files and benchmarks of the run belong to the parent
+        for (auto& stream : results_streams()) {
+            (void)stream.release();
+        }
+        results_streams().clear();
+        benchmark_results().clear();
+        results_streams().push_back(std::make_unique<ResultsStream>(path));
+        run();
+        std::_Exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+#endif
+
+MODEL("Timeouts")
+{
+    // Forks, which needs the other proofs to keep their locks to themselves
+    SERIAL_SUITE();
+
+    ENSURE_WITHIN("A proof finishing in time is not affected by its timeout", 60000)
+    {
+        ASSERT(true);
+    };
+
+    ENSURE("ENSURE_WITHIN overrides the default timeout")
+    {
+        auto& proofs = utest_proofs();
+        auto within = std::find_if(proofs.begin(), proofs.end(), [](auto& p) {
+            return p.suite_name == "Timeouts" && p.timeout_ms > 0;
+        });
+        if (ASSERT(within != proofs.end())) {
+            ASSERT_EQ(proof_timeout_ms(*within, 100), 60000);
+        }
+        ProofEntry plain{"S", "p", {}, {}};
+        ASSERT_EQ(proof_timeout_ms(plain, 100), 100);
+    };
+
+#if defined(UTEST_POSIX)
+    ENSURE("An expired in-process proof is recorded before exiting with 124")
+    {
+        auto path = std::filesystem::temp_directory_path() / "utest_watchdog_test.json";
+        ProofEntry stuck{"S", "stuck", {}, {}};
+        stuck.timeout_ms = 50;
+        auto status = run_forked(path, [&] {
+            Watchdog watchdog(1, 0);
+            watchdog.start(0, &stuck);
+            std::this_thread::sleep_for(10s);
+        });
+        auto records = read_results_file(path);
+        std::filesystem::remove(path);
+
+        ASSERT_EQ(status, utest_timeout_exit_code);
+        if (ASSERT_EQ(records.size(), 1u)) {
+            ASSERT_EQ(records[0]["name"], "S::stuck");
+            ASSERT_EQ(records[0]["passed"], "false");
+        }
+    };
+
+    ENSURE("A proof that throws does not time out while the others finish")
+    {
+        auto path = std::filesystem::temp_directory_path() / "utest_throwing_timeout_test.json";
+        ProofEntry throwing{"S", "throwing", make_fixture<EmptyFixture>, [](BaseFixture*) {
+            throw std::runtime_error("thrown");
+        }};
+        throwing.timeout_ms = 20;
+        ProofEntry slow{"S", "slow", make_fixture<EmptyFixture>, [](BaseFixture*) {
+            std::this_thread::sleep_for(200ms);
+        }};
+        slow.timeout_ms = 10000;
+        auto status = run_forked(path, [&] {
+            // In process, where the watchdog has the slots
+            unsetenv("ISOLATE");
+            try {
+                run_proof_phase({&slow, &throwing}, 2, {}, 0);
+            }
+            catch (const std::runtime_error&) {
+                std::_Exit(0);
+            }
+            std::_Exit(1);
+        });
+        std::filesystem::remove(path);
+        ASSERT_EQ(status, 0);
+    };
+
+    ENSURE("An expired isolated proof has its worker killed and the run goes on")
+    {
+        auto path = std::filesystem::temp_directory_path() / "utest_isolated_timeout_test.json";
+        ProofEntry stuck{"S", "stuck", make_fixture<EmptyFixture>, [](BaseFixture*) {
+            std::this_thread::sleep_for(10s);
+        }};
+        stuck.timeout_ms = 50;
+        ProofEntry quick{"S", "quick", make_fixture<EmptyFixture>, [](BaseFixture*) { }};
+        auto status = run_forked(path, [&] {
+            IsolatedRunner({&stuck, &quick}, 1, 0).run();
+            bool timed_out = std::any_of(proof_failures().begin(), proof_failures().end(), [](auto& failure) {
+                return failure.proof_name == "stuck" && failure.test == "timeout";
+            });
+            write_results_file();
+            std::_Exit(timed_out ? 0 : 1);
+        });
+        auto records = read_results_file(path);
+        std::filesystem::remove(path);
+
+        ASSERT_EQ(status, 0);
+        if (ASSERT_EQ(records.size(), 2u)) {
+            ASSERT_EQ(records[0]["name"], "S::stuck");
+            ASSERT_EQ(records[0]["passed"], "false");
+            ASSERT_EQ(records[1]["name"], "S::quick");
+            ASSERT_EQ(records[1]["passed"], "true");
+        }
+    };
+
+    ENSURE("An isolated proof whose fixture can't be set up fails and the run goes on")
+    {
+        struct Unusable : Fixture
+        {
+            void set_up_instance() override { throw std::runtime_error("no instance"); }
+        };
+        auto path = std::filesystem::temp_directory_path() / "utest_isolated_set_up_test.json";
+        ProofEntry unusable{"S", "unusable", make_fixture<Unusable>, [](BaseFixture*) { }};
+        ProofEntry quick{"S", "quick", make_fixture<EmptyFixture>, [](BaseFixture*) { }};
+        auto status = run_forked(path, [&] {
+            IsolatedRunner({&unusable, &quick}, 1, 0).run();
+            bool failed = std::any_of(proof_failures().begin(), proof_failures().end(), [](auto& failure) {
+                return failure.proof_name == "unusable" && failure.test == "uncaught exception"
+                    && failure.actual == "no instance";
+            });
+            write_results_file();
+            std::_Exit(failed ? 0 : 1);
+        });
+        auto records = read_results_file(path);
+        std::filesystem::remove(path);
+
+        ASSERT_EQ(status, 0);
+        if (ASSERT_EQ(records.size(), 2u)) {
+            ASSERT_EQ(records[0]["name"], "S::unusable");
+            ASSERT_EQ(records[0]["passed"], "false");
+            ASSERT_EQ(records[1]["name"], "S::quick");
+            ASSERT_EQ(records[1]["passed"], "true");
+        }
+    };
+
+    ENSURE("Isolated workers send back the failures of tearing down their pooled fixtures")
+    {
+        struct Pooled : Fixture
+        {
+            void reset() {}
+            void tear_down_instance() override { add_failure("f.cpp", 1, "torn down in the worker", "1", "0", "x"); }
+        };
+        auto path = std::filesystem::temp_directory_path() / "utest_isolated_tear_down_test.json";
+        ProofEntry pooled{"S", "pooled", make_fixture<Pooled>, [](BaseFixture*) { }};
+        pooled.release_fixture = release_fixture<Pooled>;
+        auto status = run_forked(path, [&] {
+            IsolatedRunner({&pooled, &pooled}, 1, 0).run();
+            auto torn_down = std::count_if(proof_failures().begin(), proof_failures().end(), [](auto& failure) {
+                return failure.test == "torn down in the worker";
+            });
+            std::_Exit(torn_down == 1 ? 0 : 1);
+        });
+        std::filesystem::remove(path);
+        ASSERT_EQ(status, 0);
+    };
+#endif
+}
+
+MODEL("Console output")
+{
+    // Captures std::cout, so nothing may print alongside
+    SERIAL_SUITE();
+
+    ENSURE("Progress on a pipe is a line per tenth and a line per failure")
+    {
+        std::ostringstream out;
+        auto previous = std::cout.rdbuf(out.rdbuf());
+        ConsoleReporter reporter(ConsoleReporter::Mode::progress, false);
+        reporter.start(20);
+        for (int i = 0; i < 20; ++i) {
+            reporter.proof("not printed");
+            reporter.finished({"S", "p" + std::to_string(i), "unittest", i != 4, 0, 0, 0});
+        }
+        std::cout.rdbuf(previous);
+
+        auto text = out.str();
+        ASSERT_EQ(std::count(text.begin(), text.end(), '\n'), 11);
+        ASSERT(text.find(" ! S::p4 failed\n") != std::string::npos);
+        ASSERT(text.ends_with("Progress: 20/20 proofs, 1 failed\n"));
+        ASSERT(text.find("not printed") == std::string::npos);
+    };
+
+    ENSURE("Lines mode prints suites and proofs")
+    {
+        std::ostringstream out;
+        auto previous = std::cout.rdbuf(out.rdbuf());
+        ConsoleReporter reporter(ConsoleReporter::Mode::lines, false);
+        reporter.suite("S");
+        reporter.proof("p");
+        reporter.finished({"S", "p", "unittest", true, 0, 0, 0});
+        std::cout.rdbuf(previous);
+
+        ASSERT_EQ(out.str(), "== S ==\n * p\n");
+    };
+
+#if defined(UTEST_POSIX)
+    ENSURE("Buffered stdout is written out by the crash flusher")
+    {
+        int fds[2];
+        ASSERT_EQ(pipe(fds), 0);
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid == 0) {
+            dup2(fds[1], STDOUT_FILENO);
+            StdoutBuffer buffer;
+            std::ostream(&buffer) << "batched";
+            buffer.flush_on_crash();
+            std::_Exit(0);
+        }
+        close(fds[1]);
+        std::string out;
+        char chunk[64];
+        for (ssize_t n; (n = read(fds[0], chunk, sizeof(chunk))) > 0;) {
+            out.append(chunk, static_cast<size_t>(n));
+        }
+        close(fds[0]);
+        waitpid(pid, nullptr, 0);
+        ASSERT_EQ(out, "batched");
+    };
+#endif
+}
+
+// Registered before main(), outside of any suite
+[[maybe_unused]] const bool suiteless_proof = [] {
+    ENSURE("A proof outside a suite")
+    {
+        ASSERT(true);
+    };
+    return true;
+}();
+
+MODEL("Registry")
+{
+    ENSURE("Proofs registered outside a suite have an empty suite name")
+    {
+        auto& proofs = utest_proofs();
+        auto suiteless = std::find_if(proofs.begin(), proofs.end(), [](auto& p) {
+            return p.proof_name == "A proof outside a suite";
+        });
+        if (ASSERT(suiteless != proofs.end())) {
+            ASSERT_EQ(suiteless->suite_name, "");
+        }
+    };
+
+    ENSURE("Suites and proofs are kept in registration order")
+    {
+        auto& suites = utest_suites();
+        auto position = [&](std::string_view name) {
+            return std::find_if(suites.begin(), suites.end(), [&](auto& s) { return s.name == name; }) - suites.begin();
+        };
+        ASSERT(position("Barrier") < position("BaseFixture"));
+        ASSERT(position("BaseFixture") < position("Registry"));
+        ASSERT(position("Registry") < static_cast<ptrdiff_t>(suites.size()));
+
+        // Proofs of one suite are contiguous
+        std::vector<std::string_view> seen;
+        for (auto& proof : utest_proofs()) {
+            if (seen.empty() || seen.back() != proof.suite_name) {
+                ASSERT(std::find(seen.begin(), seen.end(), proof.suite_name) == seen.end());
+                seen.push_back(proof.suite_name);
+            }
+        }
+    };
+
+    ENSURE("Proofs of a SERIAL_SUITE are marked serial")
+    {
+        for (auto& proof : utest_proofs()) {
+            if (proof.suite_name == "Lazy fixtures") {
+                ASSERT(proof.serial);
+            }
+        }
+    };
+
+    ENSURE("Shuffling is reproducible and keeps suites together")
+    {
+        std::vector<ProofEntry> entries;
+        for (int i = 0; i < 20; ++i) {
+            entries.push_back(ProofEntry{"S" + std::to_string(i % 4), std::to_string(i), {}, {}});
+        }
+        std::sort(entries.begin(), entries.end(), [](auto& a, auto& b) { return a.suite_name < b.suite_name; });
+        std::vector<const ProofEntry*> proofs;
+        for (auto& entry : entries) {
+            proofs.push_back(&entry);
+        }
+
+        auto shuffled = shuffle_proofs(proofs, 42);
+        ASSERT(shuffled == shuffle_proofs(proofs, 42));
+        ASSERT(shuffled != proofs);
+        ASSERT(shuffled != shuffle_proofs(proofs, 43));
+        ASSERT(std::is_permutation(shuffled.begin(), shuffled.end(), proofs.begin()));
+        size_t suite_changes = 0;
+        for (size_t i = 1; i < shuffled.size(); ++i) {
+            suite_changes += shuffled[i]->suite_name != shuffled[i - 1]->suite_name ? 1 : 0;
+        }
+        ASSERT_EQ(suite_changes, 3u);
+    };
+}
+
+STATIC_ENSURE("Static registration", "A proof defined at namespace scope runs")
+{
+    ASSERT(true);
+}
+
+class ValueFixture : public Fixture
+{
+public:
+    int32_t value = 42;
+};
+
+STATIC_ENSURE_GIVEN("Static registration", "Static proofs get their fixture", ValueFixture)
+{
+    ASSERT_EQ(fixture.value, 42);
+}
+
+MODEL("Static registration")
+{
+    ENSURE("Static proofs are listed without allocating, in definition order")
+    {
+        std::vector<std::string_view> names;
+        for (auto node = static_proofs; node; node = node->next) {
+            if (node->proof.suite_name == "Static registration"sv) {
+                names.push_back(node->proof.proof_name);
+                ASSERT(std::string_view(node->proof.filename).ends_with("test_utest.cpp"));
+            }
+        }
+        if (ASSERT_EQ(names.size(), 2u)) {
+            ASSERT_EQ(names[0], "Static proofs get their fixture");
+        }
+    };
+
+    ENSURE("Static proofs join the suite of the same name in the registry")
+    {
+        auto& proofs = utest_proofs();
+        auto first = std::find_if(proofs.begin(), proofs.end(), [](auto& p) { return p.suite_name == "Static registration"; });
+        ASSERT(proofs.end() - first >= 4);
+        ASSERT(std::all_of(first, first + 4, [](auto& p) { return p.suite_name == "Static registration"; }));
+        ASSERT(std::any_of(first, first + 4, [](auto& p) { return p.line_no > 0; }));
+    };
+}
+
+MODEL("Listing")
+{
+    ENSURE("Proofs record where they are defined")
+    {
+        auto& proofs = utest_proofs();
+        auto self = std::find_if(proofs.begin(), proofs.end(), [](auto& p) {
+            return p.proof_name == "Proofs record where they are defined";
+        });
+        if (ASSERT(self != proofs.end())) {
+            ASSERT(self->filename.ends_with("test_utest.cpp"));
+            ASSERT_EQ(self->line_no, static_cast<uint32_t>(__LINE__ - 8));
+        }
+    };
+
+    ENSURE("Listed proofs have their name and location")
+    {
+        ProofEntry a{"S", "a \"b\"", {}, {}};
+        a.filename = "f.cpp";
+        a.line_no = 12;
+
+        ASSERT_EQ(list_proofs({&a}, false), "S::a \"b\"\tf.cpp:12\n");
+        ASSERT_EQ(list_proofs({&a}, true),
+                  "[\n  {\"suite\": \"S\", \"proof\": \"a \\\"b\\\"\", \"type\": \"unittest\", "
+                  "\"file\": \"f.cpp\", \"line\": 12}\n]\n");
+        ASSERT_EQ(list_proofs({}, true), "[]\n");
+    };
+}
+
+MODEL("Concurrency stress")
+{
+    ENSURE_CONCURRENTLY("Every thread runs every iteration", 4, 10000)
+    {
+        thread.yield_point();
+        ASSERT(thread.index < 4);
+        ASSERT(thread.iteration < 10000);
+    };
+
+    ENSURE("All threads stop once the proof has failed")
+    {
+        EmptyFixture probe;
+        auto body = [&](EmptyFixture& f, StressThread& thread) {
+            // All threads are in the first iteration before the failure
+            // and see it after
+            f.sync_point("before", 3);
+            if (thread.index == 0) {
+                f.utest_assert(false, __FILE__, __LINE__, "stop");
+            }
+            f.sync_point("after", 3);
+        };
+        auto result = run_concurrently(probe, 3, 1000000, body);
+        probe.utest_take_failures();
+
+        ASSERT(result.iterations == (std::vector<uint64_t>{1, 1, 1}));
+    };
+
+    ENSURE("A failure does not strand threads waiting at a per-iteration sync point")
+    {
+        EmptyFixture probe;
+        auto body = [&](EmptyFixture& f, StressThread& thread) {
+            f.sync_point("tick", 3);
+            if (thread.index == 0 && thread.iteration == 4) {
+                f.utest_assert(false, __FILE__, __LINE__, "stop");
+            }
+        };
+        auto result = run_concurrently(probe, 3, 1000000, body);
+        probe.utest_take_failures();
+
+        // Rounds of 1, 2 and 4 iterations, the failure is seen after the third
+        ASSERT(result.iterations == (std::vector<uint64_t>{7, 7, 7}));
+    };
+
+    ENSURE("An exception on one thread is passed on")
+    {
+        EmptyFixture probe;
+        auto body = [](EmptyFixture&, StressThread& thread) {
+            if (thread.index == 1) {
+                throw std::runtime_error("boom");
+            }
+        };
+        ASSERT_THROW(
+            run_concurrently(probe, 2, 10, body);, std::runtime_error
+        );
+    };
+}
+
+MODEL("Formatting")
+{
+    ENSURE("Scalars are printed like a stream would, floats in shortest form")
+    {
+        ASSERT_EQ(format_value(42), "42");
+        ASSERT_EQ(format_value(-7ll), "-7");
+        ASSERT_EQ(format_value(true), "true");
+        ASSERT_EQ(format_value('c'), "c");
+        ASSERT_EQ(format_value(uint8_t(200)), "200");
+        ASSERT_EQ(format_value(0.1), "0.1");
+        ASSERT_EQ(format_value(1.5f), "1.5");
+        ASSERT_EQ(format_value(nullptr), "nullptr");
+        ASSERT_EQ(format_value(static_cast<int*>(nullptr)), "nullptr");
+        ASSERT_EQ(format_value(formatting::Color::green), "2");
+        ASSERT_EQ(format_value(u8"text"), "text");
+    };
+
+    ENSURE("Containers print their elements, capped in length")
+    {
+        ASSERT_EQ(format_value(std::vector<int32_t>{1, 2, 3}), "[1, 2, 3]");
+        ASSERT_EQ(format_value(std::vector<std::string>{"a", "b"}), "[\"a\", \"b\"]");
+        ASSERT_EQ(format_value((std::map<int32_t, std::string>{{1, "x"}})), "[(1, \"x\")]");
+        ASSERT_EQ(format_value((std::tuple<int32_t, bool>{1, false})), "(1, false)");
+        ASSERT_EQ(format_value(std::vector<std::vector<int32_t>>{{1}, {}}), "[[1], []]");
+
+        auto big = format_value(std::vector<int32_t>(1000, 7));
+        ASSERT(big.ends_with(", 7, ... (1000 elements)]"));
+        auto text = format_value(std::string(5000, 'x'));
+        ASSERT(text.ends_with("x... (5000 bytes)"));
+        ASSERT_EQ(text.size(), format_max_bytes + 16);
+    };
+
+    ENSURE("User types are printed through the customization points")
+    {
+        ASSERT_EQ(format_value(formatting::Point{1, 2}), "Point(1, 2)");
+        ASSERT_EQ(format_value(Celsius{21.5}), "21.5 C");
+        ASSERT_EQ(format_value(std::vector<formatting::Point>{{0, 1}}), "[Point(0, 1)]");
+        ASSERT_EQ(format_value(formatting::Opaque{0x1234}), "<2-byte object 34 12>");
+    };
+
+    ENSURE("ASSERT_EQ works on types without operator<<")
+    {
+        EmptyFixture probe;
+        ASSERT(!probe.utest_assert_eq(formatting::Opaque{1}, formatting::Opaque{2}, "f.cpp", 1, "a", "b"));
+        ASSERT(!probe.utest_assert_eq(std::vector<int32_t>{1}, std::vector<int32_t>{2}, "f.cpp", 1, "a", "b"));
+        auto failures = probe.utest_take_failures();
+        if (ASSERT_EQ(failures.size(), 2u)) {
+            ASSERT_EQ(failures[0].actual, "<2-byte object 01 00>");
+            ASSERT_EQ(failures[1].expected, "[2]");
+        }
+    };
+}
+
+MODEL("Buffer comparison")
+{
+    ENSURE("The mismatch scan finds the first difference at any offset")
+    {
+        std::vector<unsigned char> a(100, 0x5a);
+        for (size_t offset : {0u, 1u, 7u, 8u, 15u, 16u, 31u, 63u, 64u, 95u, 99u}) {
+            auto b = a;
+            b[offset] ^= 0x10;
+            b[99] ^= 0x01;
+            ASSERT_EQ(first_mismatch(a.data(), b.data(), a.size()), offset);
+        }
+        ASSERT_EQ(first_mismatch(a.data(), a.data(), a.size()), a.size());
+        ASSERT_EQ(first_mismatch(a.data(), a.data(), 0), 0u);
+    };
+
+    ENSURE("Equal buffers and ranges pass")
+    {
+        std::vector<uint32_t> a(1000, 3);
+        ASSERT_BYTES_EQ(a, a);
+        ASSERT_RANGE_EQ(a, (std::vector<uint32_t>(1000, 3)));
+        ASSERT_RANGE_EQ((std::vector<std::string>{"x", "y"}), (std::vector<std::string>{"x", "y"}));
+    };
+
+    ENSURE("A byte difference reports its offset, count and a bounded dump")
+    {
+        std::vector<char> a(4 << 20, 'a');
+        auto b = a;
+        b[100000] = 'b';
+        b[200000] = 'b';
+        EmptyFixture probe;
+        ASSERT(!probe.utest_assert_bytes_eq(a, b, "f.cpp", 1, "a", "b"));
+        ASSERT(!probe.utest_assert_bytes_eq(a, std::string(8, 'a'), "f.cpp", 1, "a", "c"));
+        auto failures = probe.utest_take_failures();
+        if (ASSERT_EQ(failures.size(), 2u)) {
+            ASSERT_EQ(failures[0].test, "a == b, 2 bytes differ");
+            ASSERT(failures[0].actual.starts_with("4194304 bytes, 0x61 at offset 100000\n"));
+            ASSERT(failures[0].expected.starts_with("4194304 bytes, 0x62 at offset 100000\n"));
+            ASSERT(failures[0].expected.find("000186a0 >62 61 ") != std::string::npos);
+            ASSERT(failures[0].actual.size() < 300);
+            ASSERT_EQ(failures[1].test, "a == c, 4194296 bytes differ");
+            ASSERT(failures[1].expected.starts_with("8 bytes, end at offset 8"));
+        }
+    };
+
+    ENSURE("A range difference reports its index and the elements around it")
+    {
+        std::vector<int32_t> a(1000);
+        std::iota(a.begin(), a.end(), 0);
+        auto b = a;
+        b[500] = -1;
+        std::vector<std::string> c{"a", "b", "c"};
+        EmptyFixture probe;
+        ASSERT(!probe.utest_assert_range_eq(a, b, "f.cpp", 1, "a", "b"));
+        ASSERT(!probe.utest_assert_range_eq(c, (std::vector<std::string>{"a", "x"}), "f.cpp", 1, "c", "d"));
+        auto failures = probe.utest_take_failures();
+        if (ASSERT_EQ(failures.size(), 2u)) {
+            ASSERT_EQ(failures[0].test, "a == b, 1 elements differ");
+            ASSERT_EQ(failures[0].expected, "1000 elements, [500] = -1, [496..] = [496, 497, 498, 499, -1, 501, 502, 503, 504]");
+            ASSERT_EQ(failures[1].test, "c == d, 2 elements differ");
+            ASSERT_EQ(failures[1].actual, "3 elements, [1] = \"b\", [0..] = [\"a\", \"b\", \"c\"]");
+        }
+    };
+}
+
+MODEL("Float tolerance")
+{
+    ENSURE("ULP distance counts representable values, across zero too")
+    {
+        ASSERT_EQ(ulp_distance(1.0f, std::nextafter(1.0f, 2.0f)), 1u);
+        ASSERT_EQ(ulp_distance(1.0, std::nextafter(std::nextafter(1.0, 0.0), 0.0)), 2u);
+        ASSERT_EQ(ulp_distance(-0.0f, 0.0f), 0u);
+        auto denorm = std::numeric_limits<double>::denorm_min();
+        ASSERT_EQ(ulp_distance(-denorm, denorm), 2u);
+        ASSERT_EQ(ulp_distance(std::nan(""), 1.0), std::numeric_limits<uint64_t>::max());
+    };
+
+    ENSURE("ASSERT_EQ keeps an absolute default that a fixture can change")
+    {
+        EmptyFixture probe;
+        ASSERT(probe.utest_cmp_eq(1.0, 1.00005));
+        ASSERT(!probe.utest_cmp_eq(1e7f, 1e7f + 1));
+        probe.float_tolerance = Tolerance{.relative = 1e-6};
+        ASSERT(probe.utest_cmp_eq(1e7f, 1e7f + 1));
+        ASSERT(!probe.utest_cmp_eq(1e-9, 2e-9));
+        probe.float_tolerance = Tolerance{.ulps = 4};
+        ASSERT(probe.utest_cmp_eq(0.1 + 0.2, 0.3));
+        ASSERT(!probe.utest_cmp_eq(std::nan(""), std::nan("")));
+    };
+
+    ENSURE("ASSERT_NEAR takes an absolute difference or a Tolerance")
+    {
+        ASSERT_NEAR(1.0, 1.05, 0.1);
+        ASSERT_NEAR(1e20, 1e20 * (1 + 1e-9), (Tolerance{.relative = 1e-8}));
+        EmptyFixture probe;
+        ASSERT(!probe.utest_assert_near(1.0f, 1.5f, 0.1, "f.cpp", 1, "a", "b"));
+        auto failures = probe.utest_take_failures();
+        if (ASSERT_EQ(failures.size(), 1u)) {
+            ASSERT_EQ(failures[0].test, "a near b");
+            ASSERT_EQ(failures[0].actual, "1");
+            ASSERT_EQ(failures[0].expected, "1.5 (absolute 0.1, off by 0.5 or 4194304 ulps)");
+        }
+    };
+
+    ENSURE("ASSERT_NEAR compares mixed types in their common type")
+    {
+        float half = 0.5f;
+        ASSERT_NEAR(half, 0.5, 1e-6);
+        ASSERT_NEAR(2.0f, 2, 1e-6);
+        ASSERT_NEAR(3, 3.0000001, (Tolerance{.absolute = 1e-6}));
+        ASSERT_NEAR(7, 8, 1.5);
+    };
+
+    ENSURE("The SIMD comparison agrees with within() at the relative margin")
+    {
+        // 1e-3 as a float is a little more, so a float bound lets this through
+        Tolerance tolerance{.relative = 1e-3};
+        float a[5] = {0x1.97086p-1f, 0x1.97086p-1f, 0x1.97086p-1f, 0x1.97086p-1f, 0x1.97086p-1f};
+        float e[5] = {0x1.9770aep-1f, 0x1.9770aep-1f, 0x1.9770aep-1f, 0x1.9770aep-1f, 0x1.9770aep-1f};
+        ASSERT(!tolerance.within(a[0], e[0]));
+        ASSERT_EQ(count_outside(a, e, 5, tolerance), 5u);
+    };
+
+    ENSURE("Infinities are only within tolerance of themselves")
+    {
+        auto inf = std::numeric_limits<double>::infinity();
+        auto nan = std::numeric_limits<double>::quiet_NaN();
+        Tolerance tolerance{.absolute = 1, .relative = 0.5, .ulps = 4};
+        ASSERT(tolerance.within(inf, inf));
+        ASSERT(tolerance.within(-inf, -inf));
+        ASSERT(!tolerance.within(inf, -inf));
+        ASSERT(!tolerance.within(inf, std::numeric_limits<double>::max()));
+        ASSERT(!tolerance.within(nan, nan));
+
+        Tolerance relative{.relative = 0.5};
+        double a[4] = {inf, -inf, inf, 1};
+        double e[4] = {-inf, inf, inf, 1};
+        ASSERT_EQ(count_outside(a, e, 4, relative), 2u);
+        auto inf_f = std::numeric_limits<float>::infinity();
+        float af[5] = {-inf_f, 1, 2, 3, inf_f};
+        float ef[5] = {inf_f, 1, 2, 3, inf_f};
+        ASSERT_EQ(count_outside(af, ef, 5, relative), 1u);
+    };
+
+    ENSURE("ASSERT_ARRAY_NEAR reports the count and the largest error")
+    {
+        std::vector<float> a(1 << 20);
+        std::iota(a.begin(), a.end(), 0.0f);
+        auto b = a;
+        ASSERT_ARRAY_NEAR(a, b, 0.0);
+        b[7] += 0.5f;
+        b[1000] -= 2;
+        b[a.size() - 1] += 0.25f;
+        ASSERT_ARRAY_NEAR(a, b, 3.0);
+
+        std::vector<double> c{1, 2, 3};
+        EmptyFixture probe;
+        ASSERT(!probe.utest_assert_array_near(a, b, Tolerance{.absolute = 0.1}, "f.cpp", 1, "a", "b"));
+        ASSERT(!probe.utest_assert_array_near(c, (std::vector<double>{1, std::nan(""), 3}), 0.1, "f.cpp", 1, "c", "d"));
+        ASSERT(!probe.utest_assert_array_near(c, (std::vector<double>{1, 2}), 0.1, "f.cpp", 1, "c", "e"));
+        auto failures = probe.utest_take_failures();
+        if (ASSERT_EQ(failures.size(), 3u)) {
+            ASSERT_EQ(failures[0].test, "a near b, 3 of 1048576 elements outside absolute 0.1");
+            ASSERT_EQ(failures[0].actual, "1048576 elements, max error 2 at [1000] = 1000");
+            ASSERT_EQ(failures[0].expected, "1048576 elements, [1000] = 998");
+            ASSERT_EQ(failures[1].actual, "3 elements, max error nan at [1] = 2");
+            ASSERT_EQ(failures[2].test, "c near e, sizes differ");
+        }
+    };
+}
+
+MODEL("Latency")
+{
+    ENSURE("Named slots are only added by get()")
+    {
+        NamedSlots<int32_t> slots;
+        ASSERT(slots.find("a") == nullptr);
+        ASSERT(slots.find("a") == nullptr);
+        slots.get("a") = 5;
+        if (ASSERT(slots.find("a") != nullptr)) {
+            ASSERT_EQ(*slots.find("a"), 5);
+        }
+        ASSERT(slots.find("b") == nullptr);
+    };
+
+    ENSURE("Time marks are steady nanoseconds looked up once")
+    {
+        auto mark = fixture.time_mark("start");
+        ASSERT(!mark.is_set());
+        ASSERT_EQ(mark.elapsed_ns(), std::numeric_limits<int64_t>::max());
+        ASSERT_EQ(fixture.time_between_marks("start", "end"), std::numeric_limits<int64_t>::max());
+        mark.mark();
+        std::this_thread::sleep_for(1ms);
+        fixture.mark_time("end");
+        ASSERT(fixture.time_mark("start").is_set());
+        ASSERT(fixture.time_between_marks_ns("start", "end") >= 1000000);
+        ASSERT(mark.elapsed_ns() >= fixture.time_between_marks_ns("start", "end"));
+    };
+
+    ENSURE("Histogram buckets are exact below 64 ns and within 1/64 above")
+    {
+        for (uint64_t ns : {0ull, 1ull, 63ull}) {
+            ASSERT_EQ(LatencyHistogram::highest_in_bucket(LatencyHistogram::bucket_of(ns)), ns);
+        }
+        for (uint64_t ns : {64ull, 65ull, 127ull, 128ull, 1000ull, 123456789ull, ~0ull}) {
+            auto highest = LatencyHistogram::highest_in_bucket(LatencyHistogram::bucket_of(ns));
+            ASSERT(highest >= ns);
+            ASSERT(highest - ns <= ns / 64);
+        }
+        ASSERT_EQ(LatencyHistogram::bucket_of(~0ull), LatencyHistogram::bucket_count - 1);
+    };
+
+    ENSURE("Percentiles come from the recorded latencies")
+    {
+        auto& rpc = fixture.latency("rpc");
+        ASSERT_EQ(rpc.percentile(99), 0u);
+        for (int64_t ns = 1; ns <= 1000; ++ns) {
+            rpc.record(ns);
+        }
+        ASSERT_EQ(&fixture.latency("rpc"), &rpc);
+        ASSERT_EQ(rpc.count(), 1000u);
+        ASSERT_EQ(rpc.percentile(50), 503u);
+        ASSERT(rpc.percentile(99) >= 990 && rpc.percentile(99) < 1000);
+        ASSERT_P99_BELOW(rpc, 1us);
+        ASSERT_PERCENTILE_BELOW("rpc", 50, 600ns);
+    };
+
+    ENSURE("Latencies can be recorded from many threads")
+    {
+        auto& rpc = fixture.latency("threads");
+        std::vector<std::thread> threads;
+        for (int32_t t = 0; t < 4; ++t) {
+            threads.emplace_back([&] {
+                for (int32_t i = 0; i < 10000; ++i) {
+                    rpc.record(100);
+                }
+                fixture.record_latency("threads", 5000);
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        ASSERT_EQ(rpc.count(), 40004u);
+        ASSERT_EQ(rpc.percentile(100), 5055u);
+    };
+
+    ENSURE("A slow percentile fails with the samples it was computed from")
+    {
+        EmptyFixture probe;
+        probe.record_latency("rpc", 300000);
+        ASSERT(!probe.utest_assert_percentile_below("rpc", 99, 200us, "f.cpp", 1, "\"rpc\""));
+        ASSERT(!probe.utest_assert_percentile_below("none", 99, 200us, "f.cpp", 1, "\"none\""));
+        auto failures = probe.utest_take_failures();
+        if (ASSERT_EQ(failures.size(), 2u)) {
+            ASSERT_EQ(failures[0].test, "p99 of \"rpc\" below 200000 ns");
+            ASSERT_EQ(failures[0].actual, "p99 303103 ns of 1 samples, max 303103 ns");
+            ASSERT_EQ(failures[1].actual, "p99 0 ns of 0 samples, max 0 ns");
+        }
+    };
+}
+
+MODEL("Allocation tracking")
+{
+    ENSURE("Statements that don't allocate pass ASSERT_NO_ALLOC")
+    {
+        std::vector<int32_t> values;
+        values.reserve(16);
+        ASSERT(allocation_tracking);
+        ASSERT_NO_ALLOC({
+            values.push_back(1);
+            values.push_back(2);
+        });
+        ASSERT_MAX_ALLOCS(2, {
+            auto a = std::make_unique<int32_t>(1);
+            auto b = std::make_unique<int64_t>(2);
+            do_not_optimize(a.get());
+            do_not_optimize(b.get());
+        });
+    };
+
+    ENSURE("Allocations are counted with their size")
+    {
+        EmptyFixture probe;
+        ASSERT(!probe.utest_assert_max_allocs(1, [] {
+            auto a = std::make_unique<int32_t>(1);
+            auto b = std::make_unique<int64_t>(2);
+            do_not_optimize(a.get());
+            do_not_optimize(b.get());
+        }, "f.cpp", 1, "two"));
+        auto failures = probe.utest_take_failures();
+        if (ASSERT_EQ(failures.size(), 1u)) {
+            ASSERT_EQ(failures[0].test, "at most 1 allocations in two");
+            ASSERT_EQ(failures[0].actual, "2 allocations of 12 bytes");
+        }
+    };
+
+    ENSURE("The framework's own allocations are not counted")
+    {
+        EmptyFixture probe;
+        ASSERT_NO_ALLOC({
+            probe.add_failure("f.cpp", 1, "a long enough test to be allocated", "1", "2", "a");
+            probe.mark_time("a long enough mark name to be allocated");
+            AllocationPause pause;
+            do_not_optimize(std::make_unique<int32_t>(1).get());
+        });
+        ASSERT_EQ(probe.utest_take_failures().size(), 1u);
+    };
+
+    ENSURE("Proof results count the allocations of the proof")
+    {
+        ProofEntry entry{"S", "allocating", make_fixture<EmptyFixture>, [](BaseFixture*) {
+            for (int32_t i = 0; i < 3; ++i) {
+                do_not_optimize(std::make_unique<int64_t>(i).get());
+            }
+        }};
+        auto outcome = execute_proof(entry);
+        ASSERT_EQ(outcome.result.allocations, 3u);
+        ASSERT_EQ(outcome.result.allocated_bytes, 24u);
+
+        std::string json;
+        JsonReporter(true).add(json, outcome.result, {});
+        ASSERT(json.find("\"allocations\": 3, \"allocated_bytes\": 24") != std::string::npos);
+    };
+
+    ENSURE("Performance counters are not counted as allocations")
+    {
+        std::vector<std::string> names{"task-clock", "cycles", "page-faults"};
+        ASSERT_NO_ALLOC({
+            PerfCounters perf(names);
+            perf.start();
+            do_not_optimize(perf.stop().data());
+        });
+    };
+}
+
+// Counts what happened to each instance and to all of them
+class PooledFixture : public Fixture
+{
+public:
+    void set_up_instance() override { instance_set_ups += 1; }
+    void tear_down_instance() override { torn_down += 1; }
+    void set_up() override { uses += 1; }
+    void reset() { resets += 1; }
+
+    int32_t instance_set_ups = 0;
+    int32_t uses = 0;
+    int32_t resets = 0;
+    static inline std::atomic<int32_t> torn_down = 0;
+};
+
+class DirectlyPooledFixture : public PooledFixture { };
+
+MODEL("Fixture pooling")
+{
+    ENSURE_GIVEN("A pooled fixture is set up once and reset between proofs", PooledFixture)
+    {
+        ASSERT_EQ(fixture.instance_set_ups, 1);
+        ASSERT_EQ(fixture.resets, fixture.uses - 1);
+        ASSERT(!fixture.time_mark("used").is_set());
+        fixture.mark_time("used");
+    };
+
+    ENSURE_GIVEN("A reused fixture has no failures or marks of earlier proofs", PooledFixture)
+    {
+        ASSERT_EQ(fixture.instance_set_ups, 1);
+        ASSERT_EQ(fixture.resets, fixture.uses - 1);
+        ASSERT_EQ(fixture.utest_failure_count, 0u);
+        ASSERT(!fixture.time_mark("used").is_set());
+        fixture.mark_time("used");
+    };
+
+    ENSURE("Fixtures are kept per thread until released, unless a proof failed")
+    {
+        auto first = make_fixture<DirectlyPooledFixture>();
+        auto pointer = first.get();
+        auto before = PooledFixture::torn_down.load();
+        ASSERT(release_fixture<DirectlyPooledFixture>(std::move(first), true).empty());
+        ASSERT_EQ(PooledFixture::torn_down, before);
+
+        auto second = make_fixture<DirectlyPooledFixture>();
+        ASSERT_EQ(second.get(), pointer);
+        ASSERT_EQ(static_cast<DirectlyPooledFixture*>(second.get())->resets, 1);
+        release_fixture<DirectlyPooledFixture>(std::move(second), false);
+        ASSERT_EQ(PooledFixture::torn_down, before + 1);
+
+        auto third = make_fixture<DirectlyPooledFixture>();
+        ASSERT_EQ(static_cast<DirectlyPooledFixture*>(third.get())->resets, 0);
+        std::thread([&] {
+            release_fixture<DirectlyPooledFixture>(std::move(third), true);
+        }).join();
+        ASSERT_EQ(PooledFixture::torn_down, before + 2);
+    };
+
+    ENSURE("Fixtures without reset() are set up and torn down for every proof")
+    {
+        struct Plain : Fixture
+        {
+            void set_up_instance() override { set_ups += 1; }
+            void tear_down_instance() override { add_failure("f.cpp", 1, "torn down", "1", "0", "x"); }
+            int32_t set_ups = 0;
+        };
+        auto plain = make_fixture<Plain>();
+        ASSERT_EQ(static_cast<Plain*>(plain.get())->set_ups, 1);
+        auto failures = release_fixture<Plain>(std::move(plain), true);
+        if (ASSERT_EQ(failures.size(), 1u)) {
+            ASSERT_EQ(failures[0].test, "torn down");
+        }
+    };
+
+    ENSURE("Fixtures are set up with the names of their proof, and may throw")
+    {
+        struct Named : Fixture
+        {
+            void set_up_instance() override
+            {
+                add_failure("f.cpp", 1, "set up", "1", "0", "x");
+                if (utest_proof_name == "throwing") {
+                    throw std::runtime_error("no instance");
+                }
+            }
+        };
+        ProofEntry named{"S", "named", make_fixture<Named>, [](BaseFixture*) { }};
+        auto outcome = execute_proof(named);
+        ASSERT(!outcome.error);
+        if (ASSERT_EQ(outcome.failures.size(), 1u)) {
+            ASSERT_EQ(outcome.failures[0].suite_name, "S");
+            ASSERT_EQ(outcome.failures[0].proof_name, "named");
+        }
+
+        named.proof_name = "throwing";
+        outcome = execute_proof(named);
+        ASSERT(!outcome.result.passed);
+        if (ASSERT(outcome.error)) {
+            ASSERT_EQ(exception_message(outcome.error), "no instance");
+        }
+    };
+
+    ENSURE("An exception from tear_down_instance() is a failure")
+    {
+        struct Throwing : Fixture
+        {
+            void reset() {}
+            void tear_down_instance() override { throw std::runtime_error("cannot tear down"); }
+        };
+        auto failures = release_fixture<Throwing>(make_fixture<Throwing>(), false);
+        if (ASSERT_EQ(failures.size(), 1u)) {
+            ASSERT_EQ(failures[0].test, "uncaught exception");
+            ASSERT_EQ(failures[0].actual, "cannot tear down");
+        }
+
+        FixturePool pool;
+        pool.put(typeid(Throwing), make_fixture<Throwing>(), tear_down_fixture<Throwing>);
+        ASSERT_EQ(pool.tear_down().size(), 1u);
+    };
+}
+
+MODEL("Parameterized proofs")
+{
+    ENSURE_EACH("Every element of a range is a case", std::vector<int32_t>{2, 4, 6, 8})
+    {
+        ASSERT_EQ(param % 2, 0);
+    };
+
+    ENSURE_FORALL("Generated integers stay in range", gen::integers<int32_t>(-5, 5), 200)
+    {
+        ASSERT(param >= -5 && param <= 5);
+    };
+
+    ENSURE_FORALL("Reversing twice gives back a vector", gen::vectors(gen::integers<int16_t>(), 20), 100)
+    {
+        auto reversed = param;
+        std::reverse(reversed.begin(), reversed.end());
+        std::reverse(reversed.begin(), reversed.end());
+        ASSERT(reversed == param);
+    };
+
+    // Registered like any other, and taken back out of the run to look at
+    // what it reports
+    auto registered = utest_proofs().size();
+    ENSURE_FORALL("Values below 10", gen::integers<int32_t>(0, 1000), 50)
+    {
+        ASSERT(param < 10);
+    };
+    static const std::vector<ProofEntry> failing_forall(std::make_move_iterator(utest_proofs().begin() + registered),
+                                                        std::make_move_iterator(utest_proofs().end()));
+    utest_proofs().erase(utest_proofs().begin() + registered, utest_proofs().end());
+
+    // Every case it runs, in order
+    registered = utest_proofs().size();
+    static std::vector<int32_t> each_params;
+    ENSURE_EACH("Count to 1000", [] {
+        std::vector<int32_t> values(1000);
+        std::iota(values.begin(), values.end(), 0);
+        return values;
+    }())
+    {
+        ASSERT(param >= 0);
+        each_params.push_back(param);
+    };
+    static const std::vector<ProofEntry> counting_batches(std::make_move_iterator(utest_proofs().begin() + registered),
+                                                      std::make_move_iterator(utest_proofs().end()));
+    utest_proofs().erase(utest_proofs().begin() + registered, utest_proofs().end());
+
+    ENSURE("A failing ENSURE_FORALL reports its shrunk case and seed")
+    {
+        ASSERT_EQ(failing_forall.size(), batches_for(50));
+        uint32_t failed = 0;
+        for (uint32_t batch = 0; batch < failing_forall.size(); ++batch) {
+            auto outcome = execute_proof(failing_forall[batch]);
+            auto batch_name = case_batch_name("Values below 10", batch, static_cast<uint32_t>(failing_forall.size()));
+            ASSERT_EQ(outcome.result.proof_name, batch_name);
+            // A batch of a few cases, e.g. with a large EACH_BATCHES, may
+            // have none above 9
+            if (outcome.result.passed) {
+                continue;
+            }
+            failed += 1;
+            // The first failing case of the batch, shrunk to the boundary
+            if (ASSERT_EQ(outcome.failures.size(), 1u)) {
+                auto& name = outcome.failures[0].proof_name;
+                ASSERT(name.starts_with(batch_name + " [case "));
+                ASSERT(name.find(": 10, shrunk from ") != std::string::npos);
+                ASSERT(name.ends_with(", FORALL_SEED=" + std::to_string(forall_seed()) + "]"));
+                ASSERT_EQ(outcome.failures[0].test, "param < 10");
+            }
+        }
+        ASSERT(failed > 0);
+    };
+
+    ENSURE("The batches of an ENSURE_EACH run contiguous slices of its range")
+    {
+        ASSERT_EQ(counting_batches.size(), batches_for(1000));
+        each_params.clear();
+        for (auto& batch : counting_batches) {
+            auto before = each_params.size();
+            ASSERT(execute_proof(batch).result.passed);
+            ASSERT(std::is_sorted(each_params.begin() + static_cast<ptrdiff_t>(before), each_params.end()));
+        }
+        std::vector<int32_t> all(1000);
+        std::iota(all.begin(), all.end(), 0);
+        ASSERT(each_params == all);
+    };
+
+    ENSURE("EACH_BATCHES must be a number and is capped")
+    {
+        ASSERT_EQ(parse_case_batches(nullptr), 0u);
+        ASSERT_EQ(parse_case_batches("0"), 0u);
+        ASSERT_EQ(parse_case_batches("12"), 12u);
+        ASSERT_EQ(parse_case_batches("99999999999"), max_case_batches);
+        ASSERT_THROW(parse_case_batches("");, std::invalid_argument);
+        ASSERT_THROW(parse_case_batches("-1");, std::invalid_argument);
+        ASSERT_THROW(parse_case_batches("four");, std::invalid_argument);
+        ASSERT_THROW(parse_case_batches("4x");, std::invalid_argument);
+    };
+
+    ENSURE("Default batches depend on the case count, not the jobs")
+    {
+        auto saved = std::exchange(case_batches, 0);
+        ASSERT_EQ(batches_for(0), 1u);
+        ASSERT_EQ(batches_for(100), 1u);
+        ASSERT_EQ(batches_for(1000), 4u);
+        ASSERT_EQ(batches_for(1000000), max_default_batches);
+        case_batches = 16;
+        ASSERT_EQ(batches_for(5), 5u);
+        ASSERT_EQ(batches_for(1000), 16u);
+        case_batches = saved;
+        ASSERT_EQ(case_batch_name("p", 1, 3), "p [2/3]");
+        ASSERT_EQ(case_batch_name("p", 0, 1), "p");
+    };
+
+    ENSURE("Failing cases are reported with their parameter")
+    {
+        EmptyFixture probe;
+        probe.utest_proof_name = "p";
+        auto body = [&](EmptyFixture& fixture, int32_t param) { ASSERT(param < 3); };
+        std::vector<ProofFailure> failed;
+        for (int32_t param : {1, 5}) {
+            if (!run_case(probe, body, param, "f.cpp", 1)) {
+                label_failures(probe, failed, " [case " + format_value(param) + "]");
+            }
+        }
+        auto throwing = [](EmptyFixture&, int32_t) { throw std::runtime_error("no"); };
+        ASSERT(!run_case(probe, throwing, 0, "f.cpp", 1));
+        label_failures(probe, failed, " [thrown]");
+        if (ASSERT_EQ(failed.size(), 2u)) {
+            ASSERT_EQ(failed[0].proof_name, "p [case 5]");
+            ASSERT_EQ(failed[1].test, "uncaught exception");
+            ASSERT_EQ(failed[1].actual, "no");
+        }
+    };
+
+    ENSURE("Integers shrink toward zero or the closest bound")
+    {
+        auto integers = gen::integers<int32_t>(-100, 100);
+        auto minimal = shrink_failure(integers, 77, [](int32_t value) { return value > 10; });
+        ASSERT_EQ(minimal, 11);
+        ASSERT_EQ(shrink_failure(gen::integers<uint32_t>(5, 50), 40u, [](uint32_t) { return true; }), 5u);
+        ASSERT_EQ(shrink_failure(gen::integers<int32_t>(-50, -5), -40, [](int32_t) { return true; }), -5);
+        ASSERT(gen::integers<int64_t>().shrink(0).empty());
+    };
+
+    ENSURE("Vectors and strings shrink to a minimal failing case")
+    {
+        auto vectors = gen::vectors(gen::integers<int32_t>(0, 1000), 50);
+        auto minimal = shrink_failure(vectors, std::vector<int32_t>{3, 500, 7, 900, 2},
+                                      [](const std::vector<int32_t>& values) {
+            return std::any_of(values.begin(), values.end(), [](int32_t v) { return v > 100; });
+        });
+        ASSERT(minimal == std::vector<int32_t>{101});
+
+        auto text = shrink_failure(gen::strings(20), std::string("hello, world"), [](const std::string& value) {
+            return value.find(',') != std::string::npos;
+        });
+        ASSERT_EQ(text, ",");
+        ASSERT_EQ(shrink_failure(gen::elements({'x', 'y', 'z'}), 'z', [](char c) { return c != 'x'; }), 'y');
+    };
+
+    ENSURE("Generation is repeatable from the seed")
+    {
+        Random a(42);
+        Random b(42);
+        auto strings = gen::strings(10);
+        for (int32_t i = 0; i < 10; ++i) {
+            auto value = strings(a);
+            ASSERT_EQ(value, strings(b));
+            ASSERT(value.size() <= 10);
+        }
+        ASSERT(gen::doubles(1, 2)(a) >= 1);
+    };
+}
@@ -1,22 +1,70 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <barrier>
+#include <bit>
 #include <chrono>
+#include <cctype>
+#include <charconv>
 #include <cmath>
 #include <condition_variable>
+#include <csignal>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <functional>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <ranges>
 #include <regex>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <typeindex>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define UTEST_POSIX 1
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define UTEST_SSE2 1
+#include <emmintrin.h>
+#endif
+
 
 struct ProofFailure
 {
@@ -30,16 +78,108 @@ struct ProofFailure
     std::string actual_str;
 };
 
+// Outcome of one proof. wall_ns is measured on steady_clock around the
+// proof, cpu_ns is the CPU time of the thread that ran it and
+// max_rss_delta_kb is how much the process' peak RSS grew meanwhile.
+struct ProofResult
+{
+    std::string suite_name;
+    std::string proof_name;
+    std::string type;
+    bool passed;
+    int64_t wall_ns;
+    int64_t cpu_ns;
+    int64_t max_rss_delta_kb;
+    // Made by the thread that ran the proof, when utest_alloc.cpp is linked
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+    // The PERF_COUNTERS that could be read, by name
+    std::vector<std::pair<std::string, uint64_t>> perf_counters = {};
+};
+
+// Timing statistics of one MEASURE block, in nanoseconds per iteration.
+struct BenchmarkResult
+{
+    std::string suite_name;
+    std::string proof_name;
+    uint64_t iterations;
+    std::vector<double> samples;
+    double min_ns;
+    double median_ns;
+    double p99_ns;
+    // PERF_COUNTERS per iteration over all samples
+    std::vector<std::pair<std::string, double>> perf_per_op = {};
+};
+
+// Iterations done and time taken by each thread of an ENSURE_CONCURRENTLY
+// proof
+struct StressResult
+{
+    std::string suite_name;
+    std::string proof_name;
+    std::vector<uint64_t> iterations;
+    std::vector<int64_t> wall_ns;
+};
+
 class BaseFixture;
 
+// Everything needed to build and run one proof. The fixture itself is
+// only constructed by make_fixture right before the proof runs and is
+// handed to release_fixture, or destroyed, as soon as it has finished.
+struct ProofEntry
+{
+    std::string suite_name;
+    std::string proof_name;
+    // Given the suite and proof names, see make_fixture()
+    std::function<std::unique_ptr<BaseFixture>(std::string_view, std::string_view)> make_fixture;
+    std::function<void(BaseFixture*)> utest_wrapper;
+    // Tears the fixture down or keeps it for reuse if reusable, see
+    // release_fixture(), and returns the failures of tearing it down
+    std::vector<ProofFailure> (*release_fixture)(std::unique_ptr<BaseFixture>, bool reusable) = nullptr;
+    std::string type = "unittest";
+    // Run on the main thread even when JOBS > 1, set for benchmarks and the
+    // proofs of a SERIAL_SUITE
+    bool serial = false;
+    // Overrides PROOF_TIMEOUT for this proof when positive
+    int64_t timeout_ms = 0;
+    // Where the proof is defined, when known
+    std::string_view filename = "";
+    uint32_t line_no = 0;
+};
+
+// A suite as registered by MODEL or SUITE. Blocks using the same name, in
+// any file, make up one suite.
+struct SuiteEntry
+{
+    std::string name;
+    std::vector<std::function<void()>> functions;
+    // Set by SERIAL_SUITE()
+    bool serial = false;
+};
 
-std::unordered_map<std::string, std::vector<std::function<void()>>>& utest_suites();
-std::unordered_map<std::string, std::vector<std::unique_ptr<BaseFixture>>>& utest_suite_proofs();
-std::string& utest_active_suite_name();
+// Suites in the order they were registered
+std::vector<SuiteEntry>& utest_suites();
+// The proofs of all suites, suite by suite in registration order
+std::vector<ProofEntry>& utest_proofs();
+SuiteEntry*& utest_active_suite();
 std::vector<ProofFailure>& proof_failures();
 inline std::mutex failures_mutex;
+std::vector<ProofResult>& slowest_proofs();
+inline std::mutex proof_results_mutex;
+std::vector<BenchmarkResult>& benchmark_results();
+inline std::mutex benchmark_results_mutex;
+std::vector<StressResult>& stress_results();
+inline std::mutex stress_results_mutex;
 
 bool register_suite_function(const char* name, std::function<void()> suite_function);
+void register_failures(std::vector<ProofFailure> failures);
+// The benchmarks of BASELINE_FILE by "suite::proof" name
+const std::unordered_map<std::string, BenchmarkResult>& baselines();
+void report_result();
+void write_results_file();
+
+// Exit status of a run that was ended by the watchdog, as timeout(1) uses
+constexpr int utest_timeout_exit_code = 124;
 
 template <typename A>
 concept is_string_literal = std::is_same_v<const char*, A> || (std::is_array_v<A> && std::is_same_v<std::remove_extent_t<std::remove_const_t<A>>, char>);
@@ -47,86 +187,777 @@ concept is_string_literal = std::is_same_v<const char*, A> || (std::is_array_v<A
 template <typename A>
 concept is_u8string_literal = std::is_same_v<const char8_t*, A> || (std::is_array_v<A> && std::is_same_v<std::remove_extent_t<std::remove_const_t<A>>, char8_t>);
 
-// Helper barrier with timeout support
+// Values in failure messages are printed by format_value(). A type can
+// take part by specializing ValueFormatter with a static
+// format(std::string& out, const T& value), or by providing
+// utest_format(std::string& out, const T& value) next to it to be found by
+// argument dependent lookup. Otherwise operator<< is used if there is one,
+// ranges print their elements and anything else its bytes.
+template <typename T>
+struct ValueFormatter
+{ };
+
+// Containers print at most this many elements, strings and the output of
+// operator<< at most this many bytes
+inline constexpr size_t format_max_elements = 32;
+inline constexpr size_t format_max_bytes = 1024;
+
+template <typename T>
+concept has_value_formatter = requires(std::string& out, const T& value) { ValueFormatter<T>::format(out, value); };
+
+template <typename T>
+concept has_utest_format = requires(std::string& out, const T& value) { utest_format(out, value); };
+
+template <typename T>
+concept is_streamable = requires(std::ostream& os, const T& value) { os << value; };
+
+template <typename T>
+concept is_range = requires(const T& value) { std::begin(value); std::end(value); };
+
+template <typename T>
+concept is_tuple_like = requires { std::tuple_size<T>::value; };
+
+template <typename T>
+void format_value(std::string& out, const T& value);
+
+inline void format_text(std::string& out, std::string_view text)
+{
+    out += text.substr(0, format_max_bytes);
+    if (text.size() > format_max_bytes) {
+        out += "... (" + std::to_string(text.size()) + " bytes)";
+    }
+}
+
+template <typename T>
+void format_number(std::string& out, T value, int base = 10)
+{
+    char buffer[64];
+    std::to_chars_result result;
+    if constexpr (std::is_floating_point_v<T>) {
+        result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    }
+    else {
+        result = std::to_chars(buffer, buffer + sizeof(buffer), value, base);
+    }
+    out.append(buffer, result.ptr);
+}
+
+// Elements of ranges and tuples, with strings quoted so that the
+// separators stay unambiguous
+template <typename T>
+void format_element(std::string& out, const T& value)
+{
+    if constexpr (std::is_convertible_v<const T&, std::string_view> && !has_value_formatter<T> && !has_utest_format<T>) {
+        out += '"';
+        format_value(out, value);
+        out += '"';
+    }
+    else {
+        format_value(out, value);
+    }
+}
+
+template <typename T>
+void format_value(std::string& out, const T& value)
+{
+    if constexpr (has_value_formatter<T>) {
+        ValueFormatter<T>::format(out, value);
+    }
+    else if constexpr (has_utest_format<T>) {
+        utest_format(out, value);
+    }
+    else if constexpr (std::is_same_v<T, bool>) {
+        out += value ? "true" : "false";
+    }
+    else if constexpr (std::is_same_v<T, char> || std::is_same_v<T, char8_t>) {
+        out += static_cast<char>(value);
+    }
+    else if constexpr (std::is_arithmetic_v<T>) {
+        format_number(out, value);
+    }
+    else if constexpr (std::is_enum_v<T>) {
+        format_number(out, static_cast<std::underlying_type_t<T>>(value));
+    }
+    else if constexpr (std::is_same_v<T, std::nullptr_t>) {
+        out += "nullptr";
+    }
+    else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+        format_text(out, std::string_view(value));
+    }
+    else if constexpr (std::is_convertible_v<const T&, std::u8string_view>) {
+        std::u8string_view text(value);
+        format_text(out, std::string_view(reinterpret_cast<const char*>(text.data()), text.size()));
+    }
+    else if constexpr (std::is_pointer_v<T>) {
+        if (value) {
+            out += "0x";
+            format_number(out, reinterpret_cast<uintptr_t>(value), 16);
+        }
+        else {
+            out += "nullptr";
+        }
+    }
+    else if constexpr (is_streamable<T>) {
+        // One stream per thread, rather than one per value
+        thread_local std::ostringstream stream;
+        stream.str("");
+        stream.clear();
+        stream << value;
+        format_text(out, stream.view());
+    }
+    else if constexpr (is_range<T>) {
+        out += '[';
+        size_t count = 0;
+        for (auto& element : value) {
+            if (count == format_max_elements) {
+                auto size = static_cast<size_t>(std::distance(std::begin(value), std::end(value)));
+                out += ", ... (" + std::to_string(size) + " elements)";
+                break;
+            }
+            if (count++ > 0) {
+                out += ", ";
+            }
+            format_element(out, element);
+        }
+        out += ']';
+    }
+    else if constexpr (is_tuple_like<T>) {
+        out += '(';
+        std::apply([&](const auto&... elements) {
+            size_t count = 0;
+            ((out += count++ > 0 ? ", " : "", format_element(out, elements)), ...);
+        }, value);
+        out += ')';
+    }
+    else {
+        static constexpr char hex[] = "0123456789abcdef";
+        auto bytes = reinterpret_cast<const unsigned char*>(std::addressof(value));
+        out += "<" + std::to_string(sizeof(T)) + "-byte object";
+        for (size_t i = 0; i < std::min<size_t>(sizeof(T), 64); ++i) {
+            out += ' ';
+            out += hex[bytes[i] >> 4];
+            out += hex[bytes[i] & 0xf];
+        }
+        out += sizeof(T) > 64 ? " ...>" : ">";
+    }
+}
+
+template <typename T>
+std::string format_value(const T& value)
+{
+    std::string out;
+    format_value(out, value);
+    return out;
+}
+
+// Offset of the first byte that differs between a and b, or size when
+// they are equal. Compares 16 bytes at a time with SSE2 where available
+// and 8 otherwise.
+inline size_t first_mismatch(const unsigned char* a, const unsigned char* b, size_t size)
+{
+    size_t i = 0;
+#if defined(UTEST_SSE2)
+    for (; i + 16 <= size; i += 16) {
+        auto equal = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        auto mask = static_cast<uint32_t>(_mm_movemask_epi8(equal));
+        if (mask != 0xffff) {
+            return i + static_cast<size_t>(std::countr_zero(~mask));
+        }
+    }
+#endif
+    for (; i + 8 <= size; i += 8) {
+        uint64_t x;
+        uint64_t y;
+        std::memcpy(&x, a + i, 8);
+        std::memcpy(&y, b + i, 8);
+        if (x != y) {
+            auto bits = std::endian::native == std::endian::little ? std::countr_zero(x ^ y) : std::countl_zero(x ^ y);
+            return i + static_cast<size_t>(bits) / 8;
+        }
+    }
+    for (; i < size; ++i) {
+        if (a[i] != b[i]) {
+            return i;
+        }
+    }
+    return size;
+}
+
+inline size_t count_mismatches(const unsigned char* a, const unsigned char* b, size_t size)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < size; ++i) {
+        count += a[i] != b[i] ? 1 : 0;
+    }
+    return count;
+}
+
+// Hex dump of the 16 byte lines of data from context lines before the one
+// holding offset to context lines after it
+inline void format_hex_dump(std::string& out, const unsigned char* data, size_t size, size_t offset, size_t context = 1)
+{
+    static constexpr char hex[] = "0123456789abcdef";
+    auto line = offset / 16;
+    auto first = line > context ? line - context : 0;
+    auto last = std::min(line + context, size > 0 ? (size - 1) / 16 : 0);
+    for (auto l = first; l <= last && l * 16 < std::max<size_t>(size, 1); ++l) {
+        out += "\n     ";
+        for (int shift = 28; shift >= 0; shift -= 4) {
+            out += hex[(l * 16 >> shift) & 0xf];
+        }
+        out += ' ';
+        std::string text;
+        for (size_t i = l * 16; i < l * 16 + 16; ++i) {
+            out += i == offset ? '>' : ' ';
+            if (i < size) {
+                out += hex[data[i] >> 4];
+                out += hex[data[i] & 0xf];
+                text += std::isprint(data[i]) ? static_cast<char>(data[i]) : '.';
+            }
+            else {
+                out += "  ";
+            }
+        }
+        out += "  |" + text + "|";
+    }
+}
+
+template <typename T>
+concept is_contiguous_range = requires(const T& value) { std::data(value); std::size(value); }
+                              && std::is_trivially_copyable_v<std::remove_cvref_t<decltype(*std::data(std::declval<const T&>()))>>;
+
+// Number of representable values between a and b, 0 for -0.0 and 0.0 and
+// the maximum when either is NaN
+template <std::floating_point T>
+uint64_t ulp_distance(T a, T b)
+{
+    if (std::isnan(a) || std::isnan(b)) {
+        return std::numeric_limits<uint64_t>::max();
+    }
+    using I = std::conditional_t<sizeof(T) == 4, int32_t, int64_t>;
+    // Map the sign-magnitude bit patterns onto ordered integers
+    auto ordered = [](T v) {
+        auto i = std::bit_cast<I>(v);
+        return static_cast<int64_t>(i < 0 ? std::numeric_limits<I>::min() - i : i);
+    };
+    auto x = static_cast<uint64_t>(ordered(a));
+    auto y = static_cast<uint64_t>(ordered(b));
+    return ordered(a) > ordered(b) ? x - y : y - x;
+}
+
+// How far apart two floating point values may be and still compare equal.
+// Values pass when they are equal, closer than absolute, within relative of
+// the larger magnitude or at most ulps representable values apart, e.g.
+// Tolerance{.relative = 1e-6} or Tolerance{.ulps = 4}.
+struct Tolerance
+{
+    double absolute = 0;
+    double relative = 0;
+    uint64_t ulps = 0;
+
+    template <std::floating_point T>
+    bool within(T a, T b) const
+    {
+        if (a == b) {
+            return true;
+        }
+        // Infinities only match themselves, and NaN nothing, whatever the
+        // bounds, which would scale to infinity
+        if (!std::isfinite(a) || !std::isfinite(b)) {
+            return false;
+        }
+        auto diff = std::fabs(b - a);
+        return diff < absolute
+            || diff <= relative * std::max(std::fabs(a), std::fabs(b))
+            || (ulps > 0 && ulp_distance(a, b) <= ulps);
+    }
+
+    std::string describe() const
+    {
+        std::string out;
+        auto add = [&](std::string_view name, auto value) {
+            out += out.empty() ? "" : " or ";
+            out += name;
+            out += ' ';
+            format_value(out, value);
+        };
+        if (absolute > 0) {
+            add("absolute", absolute);
+        }
+        if (relative > 0) {
+            add("relative", relative);
+        }
+        if (ulps > 0) {
+            add("ulps", ulps);
+        }
+        return out.empty() ? "exact" : out;
+    }
+};
+
+// Number of elements of a and e that are not within tolerance of each
+// other. Compares 4 floats or 2 doubles at a time with SSE2 against the
+// absolute and relative bounds and only checks lanes that miss those one
+// by one, or all of them if ulps are allowed. Like within(), floats are
+// subtracted as floats and compared against the bounds as doubles, and a
+// difference that isn't finite is never within them.
+template <std::floating_point T>
+size_t count_outside(const T* a, const T* e, size_t size, const Tolerance& tolerance)
+{
+    size_t count = 0;
+    size_t i = 0;
+#if defined(UTEST_SSE2)
+    if constexpr (std::is_same_v<T, float>) {
+        auto sign = _mm_set1_ps(-0.0f);
+        auto absolute = _mm_set1_pd(tolerance.absolute);
+        auto relative = _mm_set1_pd(tolerance.relative);
+        auto infinity = _mm_set1_pd(std::numeric_limits<double>::infinity());
+        auto within_bounds = [&](__m128d diff, __m128d scale) {
+            return _mm_movemask_pd(_mm_and_pd(_mm_or_pd(_mm_cmplt_pd(diff, absolute),
+                                                        _mm_cmple_pd(diff, _mm_mul_pd(relative, scale))),
+                                              _mm_cmplt_pd(diff, infinity)));
+        };
+        for (; i + 4 <= size; i += 4) {
+            auto va = _mm_loadu_ps(a + i);
+            auto ve = _mm_loadu_ps(e + i);
+            auto diff = _mm_andnot_ps(sign, _mm_sub_ps(va, ve));
+            auto scale = _mm_max_ps(_mm_andnot_ps(sign, va), _mm_andnot_ps(sign, ve));
+            auto mask = _mm_movemask_ps(_mm_cmpeq_ps(va, ve))
+                      | within_bounds(_mm_cvtps_pd(diff), _mm_cvtps_pd(scale))
+                      | within_bounds(_mm_cvtps_pd(_mm_movehl_ps(diff, diff)),
+                                      _mm_cvtps_pd(_mm_movehl_ps(scale, scale))) << 2;
+            if (mask != 0xf) {
+                for (size_t k = 0; k < 4; ++k) {
+                    if (!(mask & (1 << k)) && !tolerance.within(a[i + k], e[i + k])) {
+                        count += 1;
+                    }
+                }
+            }
+        }
+    }
+    else if constexpr (std::is_same_v<T, double>) {
+        auto sign = _mm_set1_pd(-0.0);
+        auto absolute = _mm_set1_pd(tolerance.absolute);
+        auto relative = _mm_set1_pd(tolerance.relative);
+        auto infinity = _mm_set1_pd(std::numeric_limits<double>::infinity());
+        for (; i + 2 <= size; i += 2) {
+            auto va = _mm_loadu_pd(a + i);
+            auto ve = _mm_loadu_pd(e + i);
+            auto diff = _mm_andnot_pd(sign, _mm_sub_pd(va, ve));
+            auto scale = _mm_max_pd(_mm_andnot_pd(sign, va), _mm_andnot_pd(sign, ve));
+            auto bounded = _mm_or_pd(_mm_cmplt_pd(diff, absolute), _mm_cmple_pd(diff, _mm_mul_pd(relative, scale)));
+            auto pass = _mm_or_pd(_mm_cmpeq_pd(va, ve), _mm_and_pd(bounded, _mm_cmplt_pd(diff, infinity)));
+            auto mask = _mm_movemask_pd(pass);
+            if (mask != 0x3) {
+                for (size_t k = 0; k < 2; ++k) {
+                    if (!(mask & (1 << k)) && !tolerance.within(a[i + k], e[i + k])) {
+                        count += 1;
+                    }
+                }
+            }
+        }
+    }
+#endif
+    for (; i < size; ++i) {
+        count += tolerance.within(a[i], e[i]) ? 0 : 1;
+    }
+    return count;
+}
+
+// Allocations made by a thread, counted by the operator new and delete
+// replacements of utest_alloc.cpp when it is linked in
+struct AllocationCounts
+{
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    uint64_t deallocations = 0;
+};
+
+struct AllocationCounters
+{
+    AllocationCounts counts;
+    // Nothing is counted while positive, see AllocationPause
+    uint32_t paused = 0;
+};
+
+inline constinit thread_local AllocationCounters allocation_counters;
+// Set by utest_alloc.cpp when it is linked in
+inline constinit std::atomic<bool> allocation_tracking = false;
+
+// Keeps the framework's own allocations, e.g. for failures, out of the
+// counts of the thread that makes them
+class AllocationPause
+{
+public:
+    AllocationPause() { allocation_counters.paused += 1; }
+    ~AllocationPause() { allocation_counters.paused -= 1; }
+    AllocationPause(const AllocationPause&) = delete;
+    AllocationPause& operator=(const AllocationPause&) = delete;
+};
+
+// Hint to the CPU that this is a spin-wait loop
+inline void cpu_relax()
+{
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_ia32_pause();
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Rendezvous of count threads. arrive_and_wait() is cyclic: when the last
+// of count threads arrives the barrier opens, starts its next generation
+// and can be used again right away. Waiters spin briefly, which keeps
+// hand-offs between running threads well below a microsecond, then block
+// on a condition variable. arrive() and wait() are a latch: wait() returns
+// once count threads have arrived, and from then on.
 class Barrier
 {
 public:
     Barrier(int32_t count) :
-        count_(count)
+        count_(static_cast<uint32_t>(std::max(count, 0)))
     { }
 
     void arrive()
     {
-        {
-            std::lock_guard<std::mutex> lock(count_mutex_);
-            count_ -= 1;
-        }
-        condition_.notify_all();
+        arrive_in_generation();
     }
 
     void wait(const std::chrono::milliseconds& timeout = std::chrono::milliseconds(1000000))
     {
-        try {
-            std::unique_lock<std::mutex> lock(count_mutex_);
-            if (!condition_.wait_for(lock, timeout, [this]{ return count_ == 0; })) {
-                throw std::runtime_error("Barrier timeout");
+        // The first generation ending opens the latch for good
+        if (count_ > 0 && !wait_for_next_generation(0, timeout)) {
+            throw std::runtime_error("Barrier timeout");
+        }
+    }
+
+    void arrive_and_wait(const std::chrono::milliseconds& timeout = std::chrono::milliseconds(1000000))
+    {
+        auto generation = arrive_in_generation();
+        if (!wait_for_next_generation(generation, timeout)) {
+            throw std::runtime_error("Barrier timeout");
+        }
+    }
+
+private:
+    // The generation arrived in, the last arrival starts the next one
+    uint32_t arrive_in_generation()
+    {
+        auto state = state_.load();
+        for (;;) {
+            auto generation = static_cast<uint32_t>(state >> 32);
+            bool last = static_cast<uint32_t>(state) + 1 >= count_;
+            auto next = last ? static_cast<uint64_t>(generation + 1) << 32 : state + 1;
+            if (state_.compare_exchange_weak(state, next)) {
+                if (last) {
+                    // Taking the mutex orders this with a waiter that has
+                    // checked the generation but not yet started to wait
+                    { std::lock_guard<std::mutex> lock(mutex_); }
+                    condition_.notify_all();
+                }
+                return generation;
             }
         }
-        catch (...) {
-            throw std::runtime_error("Waiting on condition variable failed");
+    }
+
+    bool wait_for_next_generation(uint32_t generation, const std::chrono::milliseconds& timeout)
+    {
+        constexpr uint32_t spins = 256;
+        constexpr uint32_t yields = 64;
+        auto passed = [&] { return static_cast<uint32_t>(state_.load() >> 32) != generation; };
+
+        for (uint32_t attempt = 0; attempt < spins + yields; ++attempt) {
+            if (passed()) {
+                return true;
+            }
+            if (attempt < spins) {
+                cpu_relax();
+            }
+            else {
+                std::this_thread::yield();
+            }
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        return condition_.wait_for(lock, timeout, passed);
+    }
+
+    const uint32_t count_;
+    // Generation in the upper 32 bits, threads arrived in it in the lower
+    std::atomic<uint64_t> state_ = 0;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+};
+
+// Nanoseconds on steady_clock
+inline int64_t steady_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Insert-only map of values by name that finds an existing value without
+// locking or allocating. Values live until the map is destroyed.
+template <typename T>
+class NamedSlots
+{
+public:
+    NamedSlots() = default;
+    NamedSlots(const NamedSlots&) = delete;
+    NamedSlots& operator=(const NamedSlots&) = delete;
+
+    ~NamedSlots()
+    {
+        for (auto& bucket : buckets_) {
+            for (auto node = bucket.load(); node;) {
+                delete std::exchange(node, node->next);
+            }
+        }
+    }
+
+    T& get(std::string_view name)
+    {
+        auto& bucket = buckets_[std::hash<std::string_view>{}(name) % buckets_.size()];
+        auto find = [&](Node* node) {
+            for (; node && node->name != name; node = node->next) { }
+            return node;
+        };
+        auto head = bucket.load(std::memory_order_acquire);
+        if (auto found = find(head)) {
+            return found->value;
+        }
+        AllocationPause pause;
+        auto added = new Node{std::string(name), {}, head};
+        while (!bucket.compare_exchange_weak(added->next, added, std::memory_order_acq_rel)) {
+            if (auto found = find(added->next)) {
+                delete added;
+                return found->value;
+            }
+        }
+        return added->value;
+    }
+
+    // The slot of this name if it exists, without adding it
+    T* find(std::string_view name)
+    {
+        auto& bucket = buckets_[std::hash<std::string_view>{}(name) % buckets_.size()];
+        auto node = bucket.load(std::memory_order_acquire);
+        for (; node && node->name != name; node = node->next) { }
+        return node ? &node->value : nullptr;
+    }
+
+    template <typename F>
+    void for_each(F&& f)
+    {
+        for (auto& bucket : buckets_) {
+            for (auto node = bucket.load(std::memory_order_acquire); node; node = node->next) {
+                f(node->value);
+            }
         }
     }
 
-    template <typename... A>
-    void arrive_and_wait(A&&... args)
+private:
+    struct Node
+    {
+        std::string name;
+        T value;
+        Node* next;
+    };
+    std::array<std::atomic<Node*>, 64> buckets_{};
+};
+
+// Handle to a named time mark, see BaseFixture::time_mark(). Marking and
+// reading is a steady_clock read and one atomic access.
+class TimeMark
+{
+public:
+    static constexpr int64_t unset = std::numeric_limits<int64_t>::min();
+
+    explicit TimeMark(std::atomic<int64_t>& ns) : ns_(&ns) { }
+
+    void mark() { ns_->store(steady_ns(), std::memory_order_relaxed); }
+    bool is_set() const { return ns_->load(std::memory_order_relaxed) != unset; }
+    // Nanoseconds on steady_clock when this was last marked, or unset
+    int64_t ns() const { return ns_->load(std::memory_order_relaxed); }
+
+    // Nanoseconds since the mark, or the maximum if it was never marked
+    int64_t elapsed_ns() const
     {
-        arrive();
-        wait(std::forward<A>(args)...);
+        auto marked = ns();
+        return marked == unset ? std::numeric_limits<int64_t>::max() : steady_ns() - marked;
     }
 
 private:
-    std::mutex count_mutex_;
-    int32_t count_ = 0;
-    std::condition_variable condition_;
+    std::atomic<int64_t>* ns_;
+};
+
+// Counts of latencies in log-linear buckets like an HDR histogram: values
+// below 64 ns are exact and larger ones fall into one of 64 buckets per
+// power of two, so a reported value is at most 1/64 over the true one.
+// Recording is a single relaxed atomic increment and safe from any thread.
+class LatencyHistogram
+{
+public:
+    static constexpr uint32_t sub_bucket_bits = 6;
+    static constexpr uint32_t sub_buckets = 1u << sub_bucket_bits;
+    static constexpr size_t bucket_count = (64 - sub_bucket_bits + 1) * sub_buckets;
+
+    static size_t bucket_of(uint64_t ns)
+    {
+        if (ns < sub_buckets) {
+            return static_cast<size_t>(ns);
+        }
+        auto shift = static_cast<uint32_t>(std::bit_width(ns)) - 1 - sub_bucket_bits;
+        return (shift + 1) * sub_buckets + static_cast<size_t>((ns >> shift) - sub_buckets);
+    }
+
+    // Largest value that falls into the bucket
+    static uint64_t highest_in_bucket(size_t bucket)
+    {
+        if (bucket < sub_buckets) {
+            return bucket;
+        }
+        auto shift = bucket / sub_buckets - 1;
+        auto lowest = (sub_buckets + bucket % sub_buckets) << shift;
+        return lowest + ((uint64_t(1) << shift) - 1);
+    }
+
+    void record(int64_t ns)
+    {
+        counts_[bucket_of(static_cast<uint64_t>(std::max<int64_t>(ns, 0)))].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void record_since(const TimeMark& mark) { record(mark.elapsed_ns()); }
+
+    uint64_t count() const
+    {
+        uint64_t total = 0;
+        for (auto& count : counts_) {
+            total += count.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    // Value at or below which percent of the recorded latencies are, 0 if
+    // none were recorded
+    uint64_t percentile(double percent) const
+    {
+        auto total = count();
+        auto rank = static_cast<uint64_t>(std::ceil(percent / 100.0 * static_cast<double>(total)));
+        rank = std::clamp<uint64_t>(rank, 1, std::max<uint64_t>(total, 1));
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < bucket_count; ++bucket) {
+            seen += counts_[bucket].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return highest_in_bucket(bucket);
+            }
+        }
+        return 0;
+    }
+
+    void reset()
+    {
+        for (auto& count : counts_) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, bucket_count> counts_{};
 };
 
 
 class BaseFixture
 {
 public:
-    virtual ~BaseFixture() {}
+    virtual ~BaseFixture()
+    {
+        utest_take_failures();
+        for (auto& bucket : sync_points_) {
+            for (auto node = bucket.load(); node;) {
+                delete std::exchange(node, node->next);
+            }
+        }
+    }
 
-    std::function<void(BaseFixture*)> utest_wrapper;
     std::string utest_suite_name;
     std::string utest_proof_name;
+    // Number of failures reported by this proof, used to decide whether
+    // it passed without looking at the shared failure list.
+    std::atomic<uint32_t> utest_failure_count = 0;
+    // Used by ASSERT_EQ on floats and doubles. A fixture or proof can
+    // assign it, e.g. Tolerance{.ulps = 4} for values far from 1.
+    Tolerance float_tolerance{.absolute = 0.0001};
 
     // TODO: Moving actual_str below test might make it easier to
     // read att the call site. 'test' expected 'actual_str' to be 'expected'
     // but was found to be 'actual'.
-    void add_failure(const std::string& filename,
+    //
+    // The assertion helpers take their location and expression text as
+    // string views of the __FILE__ and #expr literals, so that strings are
+    // only materialized here, on failure, and a passing assertion does not
+    // allocate.
+    void add_failure(std::string_view filename,
                      uint32_t line_no,
-                     const std::string& test,
-                     const std::string& actual,
-                     const std::string& expected,
-                     const std::string& actual_str)
+                     std::string_view test,
+                     std::string_view actual,
+                     std::string_view expected,
+                     std::string_view actual_str)
     {
-        std::lock_guard<std::mutex> lock(failures_mutex);
-        proof_failures().emplace_back(ProofFailure{
+        AllocationPause pause;
+        utest_put_failure(ProofFailure{
             utest_suite_name,
             utest_proof_name,
-            filename,
+            std::string(filename),
             line_no,
-            test,
-            actual,
-            expected,
-            actual_str
+            std::string(test),
+            std::string(actual),
+            std::string(expected),
+            std::string(actual_str)
         });
+        utest_failure_count += 1;
+    }
+
+    // Adds a failure to the list without counting it, to put back failures
+    // that were taken and have been counted already
+    void utest_put_failure(ProofFailure failure)
+    {
+        AllocationPause pause;
+        // Failures are pushed onto a lock-free per-fixture list so threads
+        // of the same proof don't contend on a lock, and are moved to
+        // proof_failures() once the proof has finished.
+        auto node = new FailureNode{std::move(failure), failures_head_.load(std::memory_order_relaxed)};
+        while (!failures_head_.compare_exchange_weak(node->next, node,
+                                                     std::memory_order_release,
+                                                     std::memory_order_relaxed)) { }
+    }
+
+    // Clears what a proof left on the fixture before a pooled fixture is
+    // handed to the next one
+    void utest_reset()
+    {
+        utest_take_failures();
+        utest_failure_count = 0;
+        time_marks_.for_each([](MarkSlot& slot) { slot.ns = TimeMark::unset; });
+        latencies_.for_each([](LatencyHistogram& histogram) { histogram.reset(); });
+    }
+
+    // Removes and returns the failures reported so far, oldest first
+    std::vector<ProofFailure> utest_take_failures()
+    {
+        std::vector<ProofFailure> failures;
+        auto node = failures_head_.exchange(nullptr, std::memory_order_acquire);
+        while (node) {
+            failures.push_back(std::move(node->failure));
+            delete std::exchange(node, node->next);
+        }
+        std::reverse(failures.begin(), failures.end());
+        return failures;
     }
 
     bool utest_assert(bool pred,
-                      const std::string& filename,
+                      std::string_view filename,
                       uint32_t line_no,
-                      const std::string& test,
+                      std::string_view test,
                       bool report_failure = true)
     {
         if (!pred && report_failure) {
@@ -138,19 +969,19 @@ public:
     template <typename A, typename E>
     bool utest_assert_eq(const A& actual,
                          const E& expected,
-                         const std::string& filename,
+                         std::string_view filename,
                          uint32_t line_no,
-                         const std::string& actual_str,
-                         const std::string& expected_str,
+                         std::string_view actual_str,
+                         std::string_view expected_str,
                          bool report_failure = true)
     {
         if (!(utest_cmp_eq(actual, expected))) {
             if (report_failure) {
                 add_failure(filename,
                             line_no,
-                            actual_str + " == " + expected_str,
-                            to_string(actual),
-                            to_string(expected),
+                            std::string(actual_str).append(" == ").append(expected_str),
+                            format_value(actual),
+                            format_value(expected),
                             actual_str);
             }
             return false;
@@ -159,14 +990,138 @@ public:
     }
 
 
-    template <typename A, typename B>
-    bool utest_cmp_eq(const A& a, const B& b)
-    {
-        if constexpr (is_string_literal<A> || is_string_literal<B>) {
-            return std::string(a) == std::string(b);
+    // Compares the bytes of two contiguous ranges. A failure reports the
+    // offset of the first difference, how many bytes differ and a hex dump
+    // of both around it, rather than the whole of both values.
+    template <typename A, typename E>
+    bool utest_assert_bytes_eq(const A& actual,
+                               const E& expected,
+                               std::string_view filename,
+                               uint32_t line_no,
+                               std::string_view actual_str,
+                               std::string_view expected_str,
+                               bool report_failure = true)
+        requires is_contiguous_range<A> && is_contiguous_range<E>
+    {
+        auto a = reinterpret_cast<const unsigned char*>(std::data(actual));
+        auto e = reinterpret_cast<const unsigned char*>(std::data(expected));
+        auto a_size = std::size(actual) * sizeof(*std::data(actual));
+        auto e_size = std::size(expected) * sizeof(*std::data(expected));
+        auto common = std::min(a_size, e_size);
+        auto offset = first_mismatch(a, e, common);
+        if (offset == common && a_size == e_size) {
+            return true;
+        }
+        if (report_failure) {
+            auto differing = std::to_string(count_mismatches(a + offset, e + offset, common - offset)
+                                            + std::max(a_size, e_size) - common);
+            auto describe = [&](const unsigned char* data, size_t size) {
+                std::string out = std::to_string(size) + " bytes, ";
+                if (offset < size) {
+                    static constexpr char hex[] = "0123456789abcdef";
+                    out += std::string("0x") + hex[data[offset] >> 4] + hex[data[offset] & 0xf];
+                }
+                else {
+                    out += "end";
+                }
+                out += " at offset " + std::to_string(offset);
+                format_hex_dump(out, data, size, offset);
+                return out;
+            };
+            add_failure(filename,
+                        line_no,
+                        std::string(actual_str).append(" == ").append(expected_str)
+                            .append(", ").append(differing).append(" bytes differ"),
+                        describe(a, a_size),
+                        describe(e, e_size),
+                        actual_str);
+        }
+        return false;
+    }
+
+    // Compares two ranges element by element. A failure reports the index
+    // of the first difference, how many elements differ and the elements
+    // around it.
+    template <typename A, typename E>
+    bool utest_assert_range_eq(const A& actual,
+                               const E& expected,
+                               std::string_view filename,
+                               uint32_t line_no,
+                               std::string_view actual_str,
+                               std::string_view expected_str,
+                               bool report_failure = true)
+    {
+        auto a_size = static_cast<size_t>(std::distance(std::begin(actual), std::end(actual)));
+        auto e_size = static_cast<size_t>(std::distance(std::begin(expected), std::end(expected)));
+        auto common = std::min(a_size, e_size);
+
+        using element = std::remove_cvref_t<decltype(*std::begin(actual))>;
+        size_t index;
+        if constexpr (is_contiguous_range<A> && is_contiguous_range<E>
+                      && std::is_same_v<element, std::remove_cvref_t<decltype(*std::begin(expected))>>
+                      && std::has_unique_object_representations_v<element>) {
+            // Equal values have equal bytes, so the byte scan finds it
+            index = first_mismatch(reinterpret_cast<const unsigned char*>(std::data(actual)),
+                                   reinterpret_cast<const unsigned char*>(std::data(expected)),
+                                   common * sizeof(element)) / sizeof(element);
+        }
+        else {
+            index = static_cast<size_t>(std::distance(std::begin(actual),
+                std::mismatch(std::begin(actual), std::next(std::begin(actual), static_cast<ptrdiff_t>(common)),
+                              std::begin(expected)).first));
+        }
+        if (index == common && a_size == e_size) {
+            return true;
+        }
+        if (report_failure) {
+            size_t differing = std::max(a_size, e_size) - common;
+            auto a_it = std::next(std::begin(actual), static_cast<ptrdiff_t>(index));
+            auto e_it = std::next(std::begin(expected), static_cast<ptrdiff_t>(index));
+            for (auto i = index; i < common; ++i, ++a_it, ++e_it) {
+                differing += utest_cmp_eq(*a_it, *e_it) ? 0 : 1;
+            }
+            constexpr size_t context = 4;
+            auto describe = [&](const auto& range, size_t size) {
+                std::string out = std::to_string(size) + " elements, ";
+                auto first = index > context ? index - context : 0;
+                auto last = std::min(index + context + 1, size);
+                auto it = std::next(std::begin(range), static_cast<ptrdiff_t>(first));
+                if (index < size) {
+                    out += "[" + std::to_string(index) + "] = ";
+                    format_element(out, *std::next(std::begin(range), static_cast<ptrdiff_t>(index)));
+                }
+                else {
+                    out += "end at [" + std::to_string(index) + "]";
+                }
+                out += ", [" + std::to_string(first) + "..] = [";
+                for (auto i = first; i < last; ++i, ++it) {
+                    if (i > first) {
+                        out += ", ";
+                    }
+                    format_element(out, *it);
+                }
+                out += "]";
+                return out;
+            };
+            add_failure(filename,
+                        line_no,
+                        std::string(actual_str).append(" == ").append(expected_str)
+                            .append(", ").append(std::to_string(differing)).append(" elements differ"),
+                        describe(actual, a_size),
+                        describe(expected, e_size),
+                        actual_str);
+        }
+        return false;
+    }
+
+    template <typename A, typename B>
+    bool utest_cmp_eq(const A& a, const B& b)
+    {
+        if constexpr (is_string_literal<A> || is_string_literal<B>) {
+            return std::string_view(a) == std::string_view(b);
         }
-        else if constexpr (is_u8string_literal<A> || is_u8string_literal<A>) {
-            return std::u8string(a) == std::u8string(b);
+        else if constexpr (is_u8string_literal<A> || is_u8string_literal<B>) {
+            return std::u8string_view(a) == std::u8string_view(b);
         }
         else {
             return a == b;
@@ -175,16 +1130,192 @@ public:
 
     bool utest_cmp_eq(float a, float b)
     {
-        return std::fabs(b - a) < 0.0001;
+        return float_tolerance.within(a, b);
     }
 
     bool utest_cmp_eq(double a, double b)
     {
-        return std::fabs(b - a) < 0.0001;
+        return float_tolerance.within(a, b);
+    }
+
+    template <typename A, typename E>
+    bool utest_assert_near(A actual,
+                           E expected,
+                           const Tolerance& tolerance,
+                           std::string_view filename,
+                           uint32_t line_no,
+                           std::string_view actual_str,
+                           std::string_view expected_str,
+                           bool report_failure = true)
+        requires std::is_arithmetic_v<A> && std::is_arithmetic_v<E>
+    {
+        // Compared in the common type, or as doubles if both are integers
+        using C = std::common_type_t<A, E>;
+        using T = std::conditional_t<std::is_floating_point_v<C>, C, double>;
+        return utest_assert_near_as(static_cast<T>(actual), static_cast<T>(expected), tolerance, filename,
+                                    line_no, actual_str, expected_str, report_failure);
+    }
+
+    template <std::floating_point T>
+    bool utest_assert_near_as(T actual,
+                              T expected,
+                              const Tolerance& tolerance,
+                              std::string_view filename,
+                              uint32_t line_no,
+                              std::string_view actual_str,
+                              std::string_view expected_str,
+                              bool report_failure)
+    {
+        if (tolerance.within(actual, expected)) {
+            return true;
+        }
+        if (report_failure) {
+            auto expected_text = format_value(expected);
+            expected_text += " (" + tolerance.describe() + ", off by ";
+            format_value(expected_text, std::fabs(actual - expected));
+            expected_text += " or ";
+            format_value(expected_text, ulp_distance(actual, expected));
+            expected_text += " ulps)";
+            add_failure(filename,
+                        line_no,
+                        std::string(actual_str).append(" near ").append(expected_str),
+                        format_value(actual),
+                        expected_text,
+                        actual_str);
+        }
+        return false;
+    }
+
+    template <typename A, typename E>
+    bool utest_assert_near(A actual,
+                           E expected,
+                           double absolute,
+                           std::string_view filename,
+                           uint32_t line_no,
+                           std::string_view actual_str,
+                           std::string_view expected_str,
+                           bool report_failure = true)
+        requires std::is_arithmetic_v<A> && std::is_arithmetic_v<E>
+    {
+        return utest_assert_near(actual, expected, Tolerance{.absolute = absolute}, filename, line_no,
+                                 actual_str, expected_str, report_failure);
+    }
+
+    // Compares two contiguous arrays of floats or doubles element-wise. A
+    // failure reports how many elements are out of tolerance and the
+    // largest error and where it is.
+    template <typename A, typename E>
+    bool utest_assert_array_near(const A& actual,
+                                 const E& expected,
+                                 const Tolerance& tolerance,
+                                 std::string_view filename,
+                                 uint32_t line_no,
+                                 std::string_view actual_str,
+                                 std::string_view expected_str,
+                                 bool report_failure = true)
+        requires is_contiguous_range<A> && is_contiguous_range<E>
+    {
+        using T = std::remove_cvref_t<decltype(*std::data(actual))>;
+        static_assert(std::is_floating_point_v<T>
+                      && std::is_same_v<T, std::remove_cvref_t<decltype(*std::data(expected))>>,
+                      "ASSERT_ARRAY_NEAR compares arrays of the same floating point type");
+        const T* a = std::data(actual);
+        const T* e = std::data(expected);
+        auto a_size = std::size(actual);
+        auto e_size = std::size(expected);
+        auto common = std::min(a_size, e_size);
+        auto outside = count_outside(a, e, common, tolerance);
+        if (outside == 0 && a_size == e_size) {
+            return true;
+        }
+        if (report_failure) {
+            // Only on failure: find the largest error, or the first NaN
+            size_t worst = 0;
+            T worst_error = 0;
+            for (size_t i = 0; i < common && !std::isnan(worst_error); ++i) {
+                auto error = std::fabs(a[i] - e[i]);
+                if ((std::isnan(error) || error > worst_error) && !tolerance.within(a[i], e[i])) {
+                    worst = i;
+                    worst_error = error;
+                }
+            }
+            std::string test = std::string(actual_str).append(" near ").append(expected_str).append(", ");
+            std::string actual_text = std::to_string(a_size) + " elements";
+            std::string expected_text = std::to_string(e_size) + " elements";
+            if (outside > 0) {
+                test += std::to_string(outside) + " of " + std::to_string(common) + " elements outside "
+                        + tolerance.describe();
+                actual_text += ", max error ";
+                format_value(actual_text, worst_error);
+                actual_text += " at [" + std::to_string(worst) + "] = ";
+                format_value(actual_text, a[worst]);
+                expected_text += ", [" + std::to_string(worst) + "] = ";
+                format_value(expected_text, e[worst]);
+            }
+            else {
+                test += "sizes differ";
+            }
+            add_failure(filename, line_no, test, actual_text, expected_text, actual_str);
+        }
+        return false;
+    }
+
+    template <typename A, typename E>
+    bool utest_assert_array_near(const A& actual,
+                                 const E& expected,
+                                 double absolute,
+                                 std::string_view filename,
+                                 uint32_t line_no,
+                                 std::string_view actual_str,
+                                 std::string_view expected_str,
+                                 bool report_failure = true)
+        requires is_contiguous_range<A> && is_contiguous_range<E>
+    {
+        return utest_assert_array_near(actual, expected, Tolerance{.absolute = absolute}, filename, line_no,
+                                       actual_str, expected_str, report_failure);
+    }
+
+    // Runs statement and checks that the thread made at most max
+    // allocations meanwhile. Fails when utest_alloc.cpp isn't linked, since
+    // nothing would be counted.
+    template <typename F>
+    bool utest_assert_max_allocs(uint64_t max,
+                                 F&& statement,
+                                 std::string_view filename,
+                                 uint32_t line_no,
+                                 std::string_view statement_str,
+                                 bool report_failure = true)
+    {
+        auto before = allocation_counters.counts;
+        statement();
+        auto allocations = allocation_counters.counts.allocations - before.allocations;
+        auto bytes = allocation_counters.counts.bytes - before.bytes;
+        if (allocation_tracking && allocations <= max) {
+            return true;
+        }
+        if (report_failure) {
+            AllocationPause pause;
+            auto test = "at most " + std::to_string(max) + " allocations in " + std::string(statement_str);
+            if (!allocation_tracking) {
+                add_failure(filename, line_no, test, "not counted", "utest_alloc.cpp linked in", "allocations");
+            }
+            else {
+                add_failure(filename,
+                            line_no,
+                            test,
+                            std::to_string(allocations) + " allocations of " + std::to_string(bytes) + " bytes",
+                            "at most " + std::to_string(max) + " allocations",
+                            "allocations");
+            }
+        }
+        return false;
     }
 
-    bool utest_assert_no_throw(std::function<void()> statement,
-                               const std::string& filename,
+    // The statements are taken as plain callables rather than
+    // std::function, which could allocate for larger captures.
+    template <typename F>
+    bool utest_assert_no_throw(F&& statement,
+                               std::string_view filename,
                                uint32_t line_no,
                                bool report_failure = true)
     {
@@ -205,11 +1336,11 @@ public:
         }
     }
 
-    template <typename A>
-    bool utest_assert_throw(std::function<void()> statement,
-                            const std::string& filename,
+    template <typename A, typename F>
+    bool utest_assert_throw(F&& statement,
+                            std::string_view filename,
                             uint32_t line_no,
-                            const std::string& exception_str,
+                            std::string_view exception_str,
                             bool report_failure = true)
     {
         try {
@@ -230,377 +1361,4642 @@ public:
                     // Caught base class, we were looking for some subclass
                     throw;
                 }
-                return true;
+                return true;
+            }
+        }
+        catch (...) {
+            // Wrong exception was thrown
+            try {
+                throw;
+            }
+            catch (const std::exception& ex) {
+                // Let's catch std::exception explicitly
+                // (because it's a common base class for exceptions)
+                // to produce better errors using typeid on 'ex'
+                if (report_failure) {
+                    add_failure(filename,
+                                line_no,
+                                "try {...}",
+                                typeid(ex).name(),
+                                exception_str,
+                                "exception");
+                }
+                return false;
+            }
+            catch (...) {
+                if (report_failure) {
+                    add_failure(filename,
+                                line_no,
+                                "try {...}",
+                                "<unknown>",
+                                exception_str,
+                                "exception");
+                }
+                return false;
+            }
+        }
+    }
+
+    // Wakes up TRY_ASSERT* polls on this fixture so that they re-check
+    // their condition right away instead of sleeping out their backoff.
+    void notify()
+    {
+        {
+            std::lock_guard<std::mutex> lock(notify_mutex_);
+            notify_generation_ += 1;
+        }
+        notify_condition_.notify_all();
+    }
+
+    // Calls check(false) until it returns true or timeout_ms has passed on
+    // steady_clock, then makes one final check(true) which reports the
+    // failure. Between checks it spins, then yields and then sleeps with
+    // exponential backoff up to max_backoff, a sleep that notify() cuts
+    // short.
+    static constexpr uint32_t poll_spins = 64;
+    static constexpr uint32_t poll_yields = 64;
+
+    template <typename F>
+    bool utest_poll(F&& check,
+                    int64_t timeout_ms,
+                    std::chrono::microseconds max_backoff = std::chrono::milliseconds(25))
+    {
+        using clock = std::chrono::steady_clock;
+        constexpr uint32_t spins = poll_spins;
+        constexpr uint32_t yields = poll_yields;
+
+        const auto deadline = clock::now() + std::chrono::milliseconds(timeout_ms);
+        auto backoff = std::chrono::microseconds(50);
+        for (uint32_t attempt = 0; clock::now() < deadline; ++attempt) {
+            // Read before checking so that a notify() racing with the check
+            // still ends the wait below
+            auto generation = notify_generation_.load();
+            if (check(false)) {
+                return true;
+            }
+            if (attempt < spins) {
+                continue;
+            }
+            if (attempt < spins + yields) {
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(notify_mutex_);
+            notify_condition_.wait_until(lock, std::min(deadline, clock::now() + backoff), [&] {
+                return notify_generation_ != generation;
+            });
+            backoff = std::min(backoff * 2, max_backoff);
+        }
+        return check(true);
+    }
+
+    // Waits until count threads have reached the sync point of this name.
+    // Sync points are cyclic, so a loop can use the same one in every
+    // iteration. Finding an existing one neither locks nor allocates.
+    void sync_point(std::string_view name, int32_t count = 2)
+    {
+        auto& bucket = sync_points_[(std::hash<std::string_view>{}(name) ^ static_cast<size_t>(count))
+                                    % sync_points_.size()];
+        auto find = [&](SyncPoint* node) {
+            for (; node; node = node->next) {
+                if (node->count == count && node->name == name) {
+                    return node;
+                }
+            }
+            return node;
+        };
+
+        auto head = bucket.load(std::memory_order_acquire);
+        auto point = find(head);
+        if (!point) {
+            AllocationPause pause;
+            auto added = new SyncPoint{std::string(name), count, count, head};
+            while (!bucket.compare_exchange_weak(added->next, added, std::memory_order_acq_rel)) {
+                // Someone else added a sync point to this bucket, maybe this one
+                if (auto found = find(added->next)) {
+                    delete added;
+                    added = found;
+                    break;
+                }
+            }
+            point = added;
+        }
+        point->barrier.arrive_and_wait();
+    }
+
+    // Handle to the time mark of this name. Look it up once outside a hot
+    // loop; marking through the handle neither locks nor allocates.
+    TimeMark time_mark(std::string_view name)
+    {
+        return TimeMark(time_marks_.get(name).ns);
+    }
+
+    // Latency histogram of this name, see LatencyHistogram
+    LatencyHistogram& latency(std::string_view name)
+    {
+        return latencies_.get(name);
+    }
+
+    void record_latency(std::string_view name, int64_t ns)
+    {
+        latency(name).record(ns);
+    }
+
+    void mark_time(std::string_view name)
+    {
+        time_mark(name).mark();
+    }
+
+    // Milliseconds since the mark, or the maximum if it was never marked
+    int64_t time_since_mark(std::string_view name)
+    {
+        auto ns = time_since_mark_ns(name);
+        return ns == std::numeric_limits<int64_t>::max() ? std::chrono::milliseconds::max().count()
+                                                         : ns / 1000000;
+    }
+
+    int64_t time_since_mark_ns(std::string_view name)
+    {
+        auto marked = marked_ns(name);
+        return marked == TimeMark::unset ? std::numeric_limits<int64_t>::max() : steady_ns() - marked;
+    }
+
+    // Milliseconds from mark1 to mark2, or the maximum if either was never
+    // marked
+    int64_t time_between_marks(std::string_view mark1, std::string_view mark2)
+    {
+        auto ns = time_between_marks_ns(mark1, mark2);
+        return ns == std::numeric_limits<int64_t>::max() ? ns : ns / 1000000;
+    }
+
+    int64_t time_between_marks_ns(std::string_view mark1, std::string_view mark2)
+    {
+        auto first = marked_ns(mark1);
+        auto second = marked_ns(mark2);
+        if (first == TimeMark::unset || second == TimeMark::unset) {
+            return std::numeric_limits<int64_t>::max();
+        }
+        return second - first;
+    }
+
+    bool utest_assert_percentile_below(const LatencyHistogram& histogram,
+                                       double percent,
+                                       std::chrono::nanoseconds limit,
+                                       std::string_view filename,
+                                       uint32_t line_no,
+                                       std::string_view histogram_str,
+                                       bool report_failure = true)
+    {
+        auto count = histogram.count();
+        auto value = histogram.percentile(percent);
+        if (count > 0 && value < static_cast<uint64_t>(limit.count())) {
+            return true;
+        }
+        if (report_failure) {
+            std::string name = "p";
+            format_value(name, percent);
+            auto actual = name + " " + std::to_string(value) + " ns of " + std::to_string(count)
+                          + " samples, max " + std::to_string(histogram.percentile(100)) + " ns";
+            add_failure(filename,
+                        line_no,
+                        name + " of " + std::string(histogram_str) + " below "
+                            + std::to_string(limit.count()) + " ns",
+                        actual,
+                        "below " + std::to_string(limit.count()) + " ns",
+                        histogram_str);
+        }
+        return false;
+    }
+
+    bool utest_assert_percentile_below(std::string_view histogram,
+                                       double percent,
+                                       std::chrono::nanoseconds limit,
+                                       std::string_view filename,
+                                       uint32_t line_no,
+                                       std::string_view histogram_str,
+                                       bool report_failure = true)
+    {
+        // An unknown name is reported as empty without adding it
+        static const LatencyHistogram empty;
+        auto found = latencies_.find(histogram);
+        return utest_assert_percentile_below(found ? *found : empty, percent, limit, filename, line_no,
+                                             histogram_str, report_failure);
+    }
+
+
+private:
+    struct FailureNode
+    {
+        ProofFailure failure;
+        FailureNode* next;
+    };
+
+    std::atomic<FailureNode*> failures_head_ = nullptr;
+
+    struct SyncPoint
+    {
+        std::string name;
+        int32_t count;
+        Barrier barrier;
+        SyncPoint* next;
+    };
+    // Insert-only hash buckets of sync points, see sync_point()
+    std::array<std::atomic<SyncPoint*>, 64> sync_points_{};
+
+    std::atomic<uint64_t> notify_generation_ = 0;
+    std::mutex notify_mutex_;
+    std::condition_variable notify_condition_;
+
+    struct MarkSlot
+    {
+        std::atomic<int64_t> ns = TimeMark::unset;
+    };
+
+    // Looking up a mark to read it doesn't add it, so querying arbitrary
+    // names doesn't grow the marks
+    int64_t marked_ns(std::string_view name)
+    {
+        auto slot = time_marks_.find(name);
+        return slot ? slot->ns.load(std::memory_order_relaxed) : TimeMark::unset;
+    }
+    NamedSlots<MarkSlot> time_marks_;
+    NamedSlots<LatencyHistogram> latencies_;
+};
+
+class Fixture : public BaseFixture
+{
+public:
+    // Run around every proof
+    virtual void set_up() {}
+    virtual void tear_down() {}
+    // Run once for each fixture instance, after it's constructed and before
+    // it's destroyed, so around every proof unless the fixture is pooled.
+    // A fixture with a reset() member is pooled: each worker keeps its
+    // instance for the next proof given it, calling reset() before set_up(),
+    // until the end of the run.
+    virtual void set_up_instance() {}
+    virtual void tear_down_instance() {}
+};
+
+template <typename Given>
+concept pooled_fixture = requires(Given& fixture) { fixture.reset(); };
+
+// The pooled fixtures of one thread, one per fixture type
+class FixturePool
+{
+public:
+    using TearDown = std::vector<ProofFailure> (*)(std::unique_ptr<BaseFixture>);
+
+    FixturePool() = default;
+    FixturePool(const FixturePool&) = delete;
+    FixturePool& operator=(const FixturePool&) = delete;
+
+    ~FixturePool()
+    {
+        release();
+    }
+
+    std::unique_ptr<BaseFixture> take(std::type_index type)
+    {
+        auto it = std::find_if(pooled_.begin(), pooled_.end(), [&](auto& entry) { return entry.type == type; });
+        if (it == pooled_.end()) {
+            return nullptr;
+        }
+        auto fixture = std::move(it->fixture);
+        pooled_.erase(it);
+        return fixture;
+    }
+
+    void put(std::type_index type, std::unique_ptr<BaseFixture> fixture, TearDown tear_down)
+    {
+        pooled_.push_back({type, std::move(fixture), tear_down});
+    }
+
+    // Tears down every pooled fixture and returns the failures of that
+    std::vector<ProofFailure> tear_down()
+    {
+        std::vector<ProofFailure> failures;
+        for (auto& entry : std::exchange(pooled_, {})) {
+            auto torn_down = entry.tear_down(std::move(entry.fixture));
+            failures.insert(failures.end(), std::make_move_iterator(torn_down.begin()),
+                            std::make_move_iterator(torn_down.end()));
+        }
+        return failures;
+    }
+
+    // Tears down every pooled fixture and registers the failures of that
+    void release()
+    {
+        register_failures(tear_down());
+    }
+
+private:
+    struct Entry
+    {
+        std::type_index type;
+        std::unique_ptr<BaseFixture> fixture;
+        TearDown tear_down;
+    };
+    std::vector<Entry> pooled_;
+};
+
+inline FixturePool& fixture_pool()
+{
+    static thread_local FixturePool pool;
+    return pool;
+}
+
+class EmptyFixture : public Fixture { };
+
+// Keeps the compiler from optimizing away a value computed in a MEASURE
+// block, or from assuming memory is unchanged across clobber_memory().
+template <typename T>
+inline void do_not_optimize(T&& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+inline void clobber_memory()
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : : "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+// Counter names in PERF_COUNTERS, e.g. "cycles,instructions,cache-misses"
+inline const std::vector<std::string>& perf_counter_names()
+{
+    static const auto names = [] {
+        std::vector<std::string> split;
+        std::string_view list = getenv("PERF_COUNTERS") ? getenv("PERF_COUNTERS") : "";
+        while (!list.empty()) {
+            auto comma = std::min(list.find(','), list.size());
+            if (comma > 0) {
+                split.emplace_back(list.substr(0, comma));
+            }
+            list.remove_prefix(std::min(comma + 1, list.size()));
+        }
+        return split;
+    }();
+    return names;
+}
+
+// The PERF_COUNTERS of the calling thread, and of the threads it starts
+// while counting, read with perf_event_open on Linux. Every counter has a
+// file descriptor of its own, so those that are unknown or that the kernel,
+// container or hardware doesn't provide are left out. Elsewhere there are
+// none. Opening and reading them isn't counted as allocations.
+class PerfCounters
+{
+public:
+    PerfCounters() : PerfCounters(perf_counter_names()) {}
+
+    explicit PerfCounters(const std::vector<std::string>& names)
+    {
+#if defined(__linux__)
+        AllocationPause pause;
+        struct Event
+        {
+            std::string_view name;
+            uint32_t type;
+            uint64_t config;
+        };
+        static constexpr Event events[] = {
+            {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {"cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+            {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {"branches", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+            {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {"task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+            {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+            {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+            {"cpu-migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+        };
+        for (auto& name : names) {
+            auto event = std::find_if(std::begin(events), std::end(events), [&](auto& e) { return e.name == name; });
+            if (event == std::end(events)) {
+                continue;
+            }
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = event->type;
+            attr.config = event->config;
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            auto fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+            if (fd >= 0) {
+                counters_.push_back({name, fd});
+            }
+        }
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#if defined(__linux__)
+        for (auto& counter : counters_) {
+            close(counter.fd);
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool empty() const
+    {
+        return counters_.empty();
+    }
+
+    void start()
+    {
+#if defined(__linux__)
+        for (auto& counter : counters_) {
+            ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    // Counts since start(), scaled up for the time the kernel had to
+    // multiplex a counter out
+    std::vector<std::pair<std::string, uint64_t>> stop()
+    {
+        AllocationPause pause;
+        std::vector<std::pair<std::string, uint64_t>> counts;
+#if defined(__linux__)
+        for (auto& counter : counters_) {
+            ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+        for (auto& counter : counters_) {
+            uint64_t values[3];
+            if (read(counter.fd, values, sizeof(values)) != static_cast<ssize_t>(sizeof(values))) {
+                continue;
+            }
+            auto [value, enabled, running] = values;
+            if (running > 0 && running < enabled) {
+                value = static_cast<uint64_t>(static_cast<double>(value) * enabled / running);
+            }
+            counts.emplace_back(counter.name, value);
+        }
+#endif
+        return counts;
+    }
+
+private:
+    struct Counter
+    {
+        std::string name;
+        int fd;
+    };
+    std::vector<Counter> counters_;
+};
+
+// Nearest-rank percentile of already sorted samples, p in [0, 1]
+inline double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    auto rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+// One-sided p-value of a Mann-Whitney U test of a being larger than b, by
+// the normal approximation with a correction for ties. Small values mean a
+// is very unlikely to have come from the same distribution as b.
+inline double mann_whitney_greater(const std::vector<double>& a, const std::vector<double>& b)
+{
+    if (a.empty() || b.empty()) {
+        return 1;
+    }
+    std::vector<std::pair<double, bool>> all;
+    all.reserve(a.size() + b.size());
+    for (auto value : a) {
+        all.emplace_back(value, true);
+    }
+    for (auto value : b) {
+        all.emplace_back(value, false);
+    }
+    std::sort(all.begin(), all.end());
+
+    const double n1 = static_cast<double>(a.size());
+    const double n2 = static_cast<double>(b.size());
+    const double n = n1 + n2;
+    double rank_sum = 0;
+    double ties = 0;
+    for (size_t i = 0; i < all.size();) {
+        auto j = i;
+        size_t from_a = 0;
+        for (; j < all.size() && all[j].first == all[i].first; ++j) {
+            from_a += all[j].second ? 1 : 0;
+        }
+        // Tied values share the average of their ranks
+        auto t = static_cast<double>(j - i);
+        rank_sum += (static_cast<double>(i + 1 + j) / 2) * static_cast<double>(from_a);
+        ties += t * t * t - t;
+        i = j;
+    }
+    auto u = rank_sum - n1 * (n1 + 1) / 2;
+    auto mean = n1 * n2 / 2;
+    auto variance = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+    if (variance <= 0) {
+        return u > mean ? 0 : 1;
+    }
+    auto z = (u - mean - 0.5) / std::sqrt(variance);
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+// Describes how current regressed from baseline, or returns nothing. The
+// median regressed when the samples are slower than the baseline's samples
+// made threshold (e.g. 0.1 for 10%) slower, with a p-value below alpha. The
+// p99 regressed when it is more than threshold slower and the samples are
+// slower at all with that confidence. Without samples the statistics
+// themselves are compared.
+inline std::optional<std::string> find_regression(const BenchmarkResult& current,
+                                                  const BenchmarkResult& baseline,
+                                                  double threshold,
+                                                  double alpha)
+{
+    auto fixed = [](double value, int precision) {
+        char buffer[64];
+        auto end = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, precision).ptr;
+        return std::string(buffer, end);
+    };
+    auto describe = [&](std::string_view what, double now, double before, std::optional<double> p) {
+        auto out = std::string(what) + " " + fixed(now, 1) + " ns/op vs baseline " + fixed(before, 1) + " ns/op ("
+                   + (now >= before ? "+" : "") + fixed(before > 0 ? (now / before - 1) * 100 : 0, 1) + "%";
+        if (p) {
+            out += ", p = " + fixed(*p, 6);
+        }
+        return out + ")";
+    };
+
+    const double scale = 1 + threshold;
+    if (current.samples.empty() || baseline.samples.empty()) {
+        if (current.median_ns > baseline.median_ns * scale) {
+            return describe("median", current.median_ns, baseline.median_ns, std::nullopt);
+        }
+        if (current.p99_ns > baseline.p99_ns * scale) {
+            return describe("p99", current.p99_ns, baseline.p99_ns, std::nullopt);
+        }
+        return std::nullopt;
+    }
+
+    auto scaled = baseline.samples;
+    for (auto& sample : scaled) {
+        sample *= scale;
+    }
+    auto p_median = mann_whitney_greater(current.samples, scaled);
+    if (p_median < alpha) {
+        return describe("median", current.median_ns, baseline.median_ns, p_median);
+    }
+    if (current.p99_ns > baseline.p99_ns * scale) {
+        auto p_slower = mann_whitney_greater(current.samples, baseline.samples);
+        if (p_slower < alpha) {
+            return describe("p99", current.p99_ns, baseline.p99_ns, p_slower);
+        }
+    }
+    return std::nullopt;
+}
+
+// Runs body in batches whose size is scaled until a batch takes at least
+// BENCH_SAMPLE_US (default 1000 us), which doubles as warm-up, and then
+// records BENCH_SAMPLES (default 50) batches as nanoseconds per iteration.
+// A batch has at most max_bench_iterations, for bodies the optimizer has
+// reduced to nothing.
+inline constexpr uint64_t max_bench_iterations = 1000000000;
+
+template <typename F>
+BenchmarkResult measure(F&& body)
+{
+    using clock = std::chrono::steady_clock;
+
+    const char* samples_env = getenv("BENCH_SAMPLES");
+    const char* sample_us_env = getenv("BENCH_SAMPLE_US");
+    const uint32_t sample_count = std::max<uint32_t>(
+        samples_env ? std::strtoul(samples_env, nullptr, 10) : 50, 1);
+    const auto sample_time = std::chrono::microseconds(
+        sample_us_env ? std::strtoul(sample_us_env, nullptr, 10) : 1000);
+
+    auto run_batch = [&body](uint64_t iterations) {
+        auto start = clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            body();
+        }
+        return clock::now() - start;
+    };
+
+    uint64_t iterations = 1;
+    for (;;) {
+        auto elapsed = run_batch(iterations);
+        if (elapsed >= sample_time || iterations >= max_bench_iterations) {
+            break;
+        }
+        if (elapsed * 10 < sample_time) {
+            iterations *= 10;
+        }
+        else {
+            // Aim 10% past the sample time so the next batch is long enough
+            iterations = static_cast<uint64_t>(
+                iterations * 1.1 * sample_time / std::max(elapsed, clock::duration(1))) + 1;
+        }
+        iterations = std::min(iterations, max_bench_iterations);
+    }
+
+    BenchmarkResult result{{}, {}, iterations, {}, 0, 0, 0};
+    result.samples.reserve(sample_count);
+    PerfCounters perf;
+    perf.start();
+    for (uint32_t i = 0; i < sample_count; ++i) {
+        std::chrono::duration<double, std::nano> elapsed = run_batch(iterations);
+        result.samples.push_back(elapsed.count() / iterations);
+    }
+    for (auto& [name, count] : perf.stop()) {
+        result.perf_per_op.emplace_back(name, static_cast<double>(count) / (static_cast<double>(iterations) * sample_count));
+    }
+
+    auto sorted = result.samples;
+    std::sort(sorted.begin(), sorted.end());
+    result.min_ns = sorted.front();
+    result.median_ns = percentile(sorted, 0.5);
+    result.p99_ns = percentile(sorted, 0.99);
+    return result;
+}
+
+inline std::string exception_message(std::exception_ptr error)
+{
+    try {
+        std::rethrow_exception(error);
+    }
+    catch (const std::exception& ex) {
+        return ex.what();
+    }
+    catch (...) {
+        return "<unknown>";
+    }
+}
+
+// A pooled fixture from this thread's pool if it has one, reset for the
+// next proof, and otherwise a new instance that has been set up. Either
+// way it carries the names of the proof, so that failures of reset() or
+// set_up_instance() are the proof's.
+template <typename Given>
+std::unique_ptr<BaseFixture> make_fixture(std::string_view suite_name = {}, std::string_view proof_name = {})
+{
+    if constexpr (pooled_fixture<Given>) {
+        if (auto fixture = fixture_pool().take(typeid(Given))) {
+            fixture->utest_reset();
+            fixture->utest_suite_name = suite_name;
+            fixture->utest_proof_name = proof_name;
+            static_cast<Given*>(fixture.get())->reset();
+            return fixture;
+        }
+    }
+    auto fixture = std::unique_ptr<BaseFixture>{static_cast<BaseFixture*>(new Given{})};
+    fixture->utest_suite_name = suite_name;
+    fixture->utest_proof_name = proof_name;
+    if constexpr (requires(Given& given) { given.set_up_instance(); }) {
+        static_cast<Given*>(fixture.get())->set_up_instance();
+    }
+    return fixture;
+}
+
+// Runs after the proof, or at the end of the run from a thread's pool
+// where nothing could catch an exception, so that becomes a failure of
+// the last proof given the fixture
+template <typename Given>
+std::vector<ProofFailure> tear_down_fixture(std::unique_ptr<BaseFixture> fixture)
+{
+    if constexpr (requires(Given& given) { given.tear_down_instance(); }) {
+        try {
+            static_cast<Given*>(fixture.get())->tear_down_instance();
+        }
+        catch (...) {
+            fixture->add_failure(__FILE__, __LINE__, "uncaught exception", exception_message(std::current_exception()),
+                                 "no exception", "tear_down_instance()");
+        }
+    }
+    return fixture->utest_take_failures();
+}
+
+// Keeps a pooled fixture for the next proof on this thread unless the
+// proof failed, which may have left it in a state reset() doesn't expect,
+// and tears down the others
+template <typename Given>
+std::vector<ProofFailure> release_fixture(std::unique_ptr<BaseFixture> fixture, bool reusable)
+{
+    if constexpr (pooled_fixture<Given>) {
+        if (reusable) {
+            fixture_pool().put(typeid(Given), std::move(fixture), tear_down_fixture<Given>);
+            return {};
+        }
+    }
+    return tear_down_fixture<Given>(std::move(fixture));
+}
+
+// Returned by register_proof so that ENSURE_GIVEN can be followed by the
+// proof body, which is assigned to it as a lambda taking the fixture.
+template <typename Given>
+struct ProofRegistrar
+{
+    ProofEntry& entry;
+
+    template <typename F>
+    void operator=(F&& proof)
+    {
+        entry.make_fixture = make_fixture<Given>;
+        entry.release_fixture = release_fixture<Given>;
+        entry.utest_wrapper = [proof = std::forward<F>(proof)](BaseFixture* a) {
+            Given* utest_fixture_ = static_cast<Given*>(a);
+            utest_fixture_->set_up();
+            proof(*utest_fixture_);
+            utest_fixture_->tear_down();
+        };
+    }
+};
+
+// Fails the benchmark proof when BASELINE_FILE has a result for it that
+// find_regression() reports it slower than, by more than BASELINE_THRESHOLD
+// percent (default 10) at a p-value below BASELINE_ALPHA (default 0.01).
+// Nothing is compared while UPDATE_BASELINE is set.
+inline void check_baseline(BaseFixture& fixture,
+                           const BenchmarkResult& result,
+                           std::string_view filename,
+                           uint32_t line_no)
+{
+    if (getenv("UPDATE_BASELINE")) {
+        return;
+    }
+    auto name = result.suite_name + "::" + result.proof_name;
+    auto baseline = baselines().find(name);
+    if (baseline == baselines().end()) {
+        return;
+    }
+    const char* threshold_env = getenv("BASELINE_THRESHOLD");
+    const char* alpha_env = getenv("BASELINE_ALPHA");
+    auto threshold = threshold_env ? std::strtod(threshold_env, nullptr) : 10.0;
+    auto alpha = alpha_env ? std::strtod(alpha_env, nullptr) : 0.01;
+    if (auto regression = find_regression(result, baseline->second, threshold / 100, alpha)) {
+        std::string test = name + " within ";
+        format_value(test, threshold);
+        fixture.add_failure(filename, line_no, test + "% of baseline", *regression, "no regression", "benchmark");
+    }
+}
+
+// Counterpart of ProofRegistrar for MEASURE. The body is run once as a
+// normal proof and, if that passed, under measure() with the results
+// collected in benchmark_results().
+template <typename Given>
+struct BenchmarkRegistrar
+{
+    ProofEntry& entry;
+
+    template <typename F>
+    void operator=(F&& body)
+    {
+        entry.make_fixture = make_fixture<Given>;
+        entry.release_fixture = release_fixture<Given>;
+        entry.utest_wrapper = [body = std::forward<F>(body),
+                               filename = entry.filename,
+                               line_no = entry.line_no](BaseFixture* a) {
+            Given* utest_fixture_ = static_cast<Given*>(a);
+            utest_fixture_->set_up();
+            body(*utest_fixture_);
+            if (utest_fixture_->utest_failure_count == 0) {
+                auto result = measure([&] { body(*utest_fixture_); });
+                result.suite_name = utest_fixture_->utest_suite_name;
+                result.proof_name = utest_fixture_->utest_proof_name;
+                check_baseline(*utest_fixture_, result, filename, line_no);
+                std::lock_guard<std::mutex> lock(benchmark_results_mutex);
+                benchmark_results().push_back(std::move(result));
+            }
+            utest_fixture_->tear_down();
+        };
+        entry.type = "benchmark";
+        entry.serial = true;
+    }
+};
+
+inline ProofEntry& add_proof_entry(const std::string& proof_name, std::string_view filename, uint32_t line_no)
+{
+    // Proofs registered outside a MODEL or SUITE belong to an unnamed suite
+    auto& proofs = utest_proofs();
+    auto suite = utest_active_suite();
+    proofs.push_back(ProofEntry{suite ? suite->name : std::string(), proof_name, {}, {}});
+    proofs.back().filename = filename;
+    proofs.back().line_no = line_no;
+    return proofs.back();
+}
+
+template <typename Given>
+ProofRegistrar<Given> register_proof(const std::string& proof_name,
+                                     std::string_view filename,
+                                     uint32_t line_no,
+                                     int64_t timeout_ms = 0)
+{
+    auto& entry = add_proof_entry(proof_name, filename, line_no);
+    entry.timeout_ms = timeout_ms;
+    return {entry};
+}
+
+template <typename Given>
+BenchmarkRegistrar<Given> register_benchmark(const std::string& proof_name, std::string_view filename, uint32_t line_no)
+{
+    return {add_proof_entry(proof_name, filename, line_no)};
+}
+
+// A proof defined at namespace scope by STATIC_ENSURE. Unlike ENSURE in a
+// suite function it costs nothing at startup but linking its node into
+// static_proofs(): no allocation, and proofs filtered out by SUITE or PROOF
+// never make it into the registry.
+struct StaticProof
+{
+    const char* suite_name;
+    const char* proof_name;
+    const char* filename;
+    uint32_t line_no;
+    std::unique_ptr<BaseFixture> (*make_fixture)(std::string_view, std::string_view);
+    void (*run)(BaseFixture*);
+    std::vector<ProofFailure> (*release_fixture)(std::unique_ptr<BaseFixture>, bool);
+};
+
+struct StaticProofNode
+{
+    const StaticProof& proof;
+    const StaticProofNode* next;
+};
+
+// The STATIC_ENSURE proofs, most recently defined first
+inline constinit const StaticProofNode* static_proofs = nullptr;
+
+inline bool link_static_proof(StaticProofNode& node)
+{
+    node.next = std::exchange(static_proofs, &node);
+    return true;
+}
+
+template <typename Given, void (*Proof)(Given&)>
+void run_static_proof(BaseFixture* a)
+{
+    Given* utest_fixture_ = static_cast<Given*>(a);
+    utest_fixture_->set_up();
+    Proof(*utest_fixture_);
+    utest_fixture_->tear_down();
+}
+
+#define STATIC_ENSURE(suite_name, what) STATIC_ENSURE_GIVEN(suite_name, what, EmptyFixture)
+#define STATIC_ENSURE_GIVEN(suite_name, what, given) STATIC_ENSURE_GEN_UNIQUE(suite_name, what, given, __LINE__)
+#define STATIC_ENSURE_GEN_UNIQUE(suite_name, what, given, unique_line) STATIC_ENSURE_INTERNAL(suite_name, what, given, unique_line)
+#define STATIC_ENSURE_INTERNAL(suite_name, what, given, unique_line) \
+    static void utest_static_proof ## unique_line(given& fixture); \
+    static constexpr StaticProof utest_static_desc ## unique_line{ \
+        suite_name, what, __FILE__, unique_line, make_fixture<given>, \
+        run_static_proof<given, utest_static_proof ## unique_line>, release_fixture<given>}; \
+    namespace {StaticProofNode utest_static_node ## unique_line{utest_static_desc ## unique_line, nullptr}; \
+               bool utest_static_reg ## unique_line = link_static_proof(utest_static_node ## unique_line);} \
+    static void utest_static_proof ## unique_line([[maybe_unused]] given& fixture)
+
+// The thread of an ENSURE_CONCURRENTLY proof that is running the body
+class StressThread
+{
+public:
+    StressThread(uint32_t index, bool yields) :
+        index(index),
+        yields_(yields),
+        random_(0x9e3779b97f4a7c15ull * (index + 1))
+    { }
+
+    // From 0 to threads - 1
+    const uint32_t index;
+    // From 0 to iterations - 1
+    uint64_t iteration = 0;
+
+    // Place in the body where, with STRESS_YIELD set, the thread randomly
+    // yields or spins for a bit to shake up how threads interleave
+    void yield_point()
+    {
+        if (!yields_) {
+            return;
+        }
+        random_ ^= random_ << 13;
+        random_ ^= random_ >> 7;
+        random_ ^= random_ << 17;
+        if (random_ % 4 == 0) {
+            std::this_thread::yield();
+        }
+        else {
+            for (auto spins = random_ % 64; spins > 0; --spins) {
+                cpu_relax();
+            }
+        }
+    }
+
+private:
+    bool yields_;
+    uint64_t random_;
+};
+
+// Pins the calling thread to the index'th CPU this process may run on,
+// where supported
+inline void pin_thread(uint32_t index)
+{
+#if defined(__linux__)
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return;
+    }
+    auto n = index % static_cast<uint32_t>(CPU_COUNT(&allowed));
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed) && n-- == 0) {
+            cpu_set_t pinned;
+            CPU_ZERO(&pinned);
+            CPU_SET(cpu, &pinned);
+            pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned);
+            return;
+        }
+    }
+#else
+    (void)index;
+#endif
+}
+
+// Runs body(fixture, thread) for iterations on each of threads new threads,
+// pinned to CPUs and started together. All threads stop early once the
+// proof has failed; the first exception is passed on after they finished.
+//
+// Threads run in rounds of 1, 2, 4, ... up to max_stress_round iterations
+// and only decide whether to stop between rounds, together. All of them
+// stop after the same iteration, so a body that waits for the others in
+// every iteration, e.g. at a sync_point, is never left waiting for a thread
+// that has stopped. A thread that throws leaves the rounds at once.
+inline constexpr uint64_t max_stress_round = 65536;
+
+template <typename Given, typename F>
+StressResult run_concurrently(Given& fixture, uint32_t threads, uint64_t iterations, F& body)
+{
+    threads = std::max<uint32_t>(threads, 1);
+    const bool yields = getenv("STRESS_YIELD") != nullptr;
+    StressResult result{fixture.utest_suite_name, fixture.utest_proof_name,
+                        std::vector<uint64_t>(threads), std::vector<int64_t>(threads)};
+    std::atomic<bool> stop = false;
+    // Set once per round while every thread waits for it
+    bool stopping = false;
+    auto decide = [&]() noexcept {
+        stopping = stop.load() || fixture.utest_failure_count.load() > 0;
+    };
+    std::barrier rounds(static_cast<std::ptrdiff_t>(threads), decide);
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    auto run = [&](uint32_t index) {
+        pin_thread(index);
+        StressThread thread(index, yields);
+        rounds.arrive_and_wait();
+        auto started = std::chrono::steady_clock::now();
+        try {
+            for (uint64_t round = 1; !stopping && thread.iteration < iterations;
+                 round = std::min(round * 2, max_stress_round)) {
+                auto end = std::min(iterations, thread.iteration + round);
+                for (; thread.iteration < end; ++thread.iteration) {
+                    body(fixture, thread);
+                }
+                rounds.arrive_and_wait();
+            }
+        }
+        catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            stop = true;
+            rounds.arrive_and_drop();
+        }
+        result.wall_ns[index] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - started).count();
+        result.iterations[index] = thread.iteration;
+    };
+
+    // Only new threads are pinned, the calling thread keeps its affinity
+    std::vector<std::thread> workers;
+    for (uint32_t index = 0; index < threads; ++index) {
+        workers.emplace_back(run, index);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return result;
+}
+
+// Counterpart of ProofRegistrar for ENSURE_CONCURRENTLY, the per-thread
+// throughput is collected in stress_results()
+template <typename Given>
+struct ConcurrentRegistrar
+{
+    ProofEntry& entry;
+    uint32_t threads;
+    uint64_t iterations;
+
+    template <typename F>
+    void operator=(F&& body)
+    {
+        entry.make_fixture = make_fixture<Given>;
+        entry.release_fixture = release_fixture<Given>;
+        entry.utest_wrapper = [body = std::forward<F>(body), threads = threads, iterations = iterations](BaseFixture* a) {
+            Given* utest_fixture_ = static_cast<Given*>(a);
+            utest_fixture_->set_up();
+            auto result = run_concurrently(*utest_fixture_, threads, iterations, body);
+            {
+                std::lock_guard<std::mutex> lock(stress_results_mutex);
+                stress_results().push_back(std::move(result));
+            }
+            utest_fixture_->tear_down();
+        };
+        entry.type = "stress";
+        // Other proofs running alongside would skew the throughput
+        entry.serial = true;
+    }
+};
+
+template <typename Given>
+ConcurrentRegistrar<Given> register_concurrent_proof(const std::string& proof_name,
+                                                     std::string_view filename,
+                                                     uint32_t line_no,
+                                                     uint32_t threads,
+                                                     uint64_t iterations)
+{
+    return {add_proof_entry(proof_name, filename, line_no), threads, iterations};
+}
+
+// Number of proofs the cases of an ENSURE_EACH or ENSURE_FORALL are split
+// into from EACH_BATCHES, or 0 when it isn't set. The batches are part of
+// the proof names, so by default they don't depend on the number of jobs.
+inline constinit uint32_t case_batches = 0;
+// Without EACH_BATCHES a parameterized proof gets a batch per this many
+// cases, and at most max_default_batches of them
+inline constexpr uint64_t cases_per_batch = 250;
+inline constexpr uint32_t max_default_batches = 8;
+// EACH_BATCHES beyond this only makes more proofs to start
+inline constexpr uint32_t max_case_batches = 1024;
+
+// The batches asked for by EACH_BATCHES, 0 when it isn't set
+inline uint32_t parse_case_batches(const char* batches)
+{
+    if (!batches) {
+        return 0;
+    }
+    std::string_view text(batches);
+    uint64_t count = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), count);
+    if (text.empty() || error != std::errc() || end != text.data() + text.size()) {
+        throw std::invalid_argument("EACH_BATCHES must be a number of batches, 0 for the default, not '"
+                                    + std::string(text) + "'");
+    }
+    return static_cast<uint32_t>(std::min<uint64_t>(count, max_case_batches));
+}
+
+// Batches of a parameterized proof of cases cases, none of them empty
+inline uint32_t batches_for(uint64_t cases)
+{
+    uint64_t batches = case_batches > 0 ? case_batches : std::min<uint64_t>(cases / cases_per_batch, max_default_batches);
+    return static_cast<uint32_t>(std::clamp<uint64_t>(batches, 1, std::max<uint64_t>(cases, 1)));
+}
+
+// Name of batch of batches, which is the proof name when there is one
+inline std::string case_batch_name(const std::string& proof_name, uint32_t batch, uint32_t batches)
+{
+    return batches > 1 ? proof_name + " [" + std::to_string(batch + 1) + "/" + std::to_string(batches) + "]"
+                       : proof_name;
+}
+
+// Runs one case of a parameterized proof. Its failures, including an
+// uncaught exception, are labelled with the case and kept in failed
+// rather than left on the fixture. Returns whether the case passed.
+template <typename Given, typename F, typename T>
+bool run_case(Given& fixture, F& body, const T& param, std::string_view filename, uint32_t line_no)
+{
+    auto before = fixture.utest_failure_count.load();
+    try {
+        body(fixture, param);
+    }
+    catch (const std::exception& ex) {
+        fixture.add_failure(filename, line_no, "uncaught exception", ex.what(), "no exception", "param");
+    }
+    catch (...) {
+        fixture.add_failure(filename, line_no, "uncaught exception", "<unknown>", "no exception", "param");
+    }
+    return fixture.utest_failure_count == before;
+}
+
+// Moves the failures on the fixture to failed, with label added to their
+// proof name
+inline void label_failures(BaseFixture& fixture, std::vector<ProofFailure>& failed, std::string_view label)
+{
+    for (auto& failure : fixture.utest_take_failures()) {
+        failure.proof_name += label;
+        failed.push_back(std::move(failure));
+    }
+}
+
+// Counterpart of ProofRegistrar for ENSURE_EACH. The range is made by
+// make_range when a batch runs, and once more when registered if it has a
+// size, to pick the batches from it. Batch i of n of a sized range runs
+// the i-th of n contiguous slices, starting from an offset into it, and of
+// other ranges the cases whose index modulo n is i. Each batch runs its
+// cases with the same fixture.
+template <typename Given, typename MakeRange>
+struct EachRegistrar
+{
+    std::string proof_name;
+    std::string_view filename;
+    uint32_t line_no;
+    MakeRange make_range;
+
+    template <typename F>
+    void operator=(F&& body)
+    {
+        auto shared = std::make_shared<std::decay_t<F>>(std::forward<F>(body));
+        uint32_t batches = std::max<uint32_t>(case_batches, 1);
+        if constexpr (std::ranges::sized_range<std::invoke_result_t<MakeRange&>>) {
+            auto range = make_range();
+            batches = batches_for(static_cast<uint64_t>(std::ranges::size(range)));
+        }
+        for (uint32_t batch = 0; batch < batches; ++batch) {
+            auto& entry = add_proof_entry(case_batch_name(proof_name, batch, batches), filename, line_no);
+            entry.make_fixture = make_fixture<Given>;
+            entry.release_fixture = release_fixture<Given>;
+            entry.utest_wrapper = [shared, make_range = make_range, batch, batches,
+                                   filename = filename, line_no = line_no](BaseFixture* a) {
+                Given* utest_fixture_ = static_cast<Given*>(a);
+                utest_fixture_->set_up();
+                std::vector<ProofFailure> failed;
+                auto run = [&](uint64_t index, const auto& param) {
+                    if (!run_case(*utest_fixture_, *shared, param, filename, line_no)) {
+                        label_failures(*utest_fixture_, failed,
+                                       " [case " + std::to_string(index) + ": " + format_value(param) + "]");
+                    }
+                };
+                auto&& range = make_range();
+                using Range = decltype(range);
+                if constexpr (std::ranges::sized_range<Range>) {
+                    auto size = static_cast<uint64_t>(std::ranges::size(range));
+                    auto first = size * batch / batches;
+                    auto last = size * (batch + 1) / batches;
+                    auto it = std::ranges::next(std::ranges::begin(range),
+                                                static_cast<std::ranges::range_difference_t<Range>>(first));
+                    for (auto index = first; index < last; ++index, ++it) {
+                        run(index, *it);
+                    }
+                }
+                else {
+                    uint64_t index = 0;
+                    for (auto&& param : range) {
+                        if (index % batches == batch) {
+                            run(index, param);
+                        }
+                        ++index;
+                    }
+                }
+                for (auto& failure : failed) {
+                    utest_fixture_->utest_put_failure(std::move(failure));
+                }
+                utest_fixture_->tear_down();
+            };
+        }
+    }
+};
+
+template <typename Given, typename MakeRange>
+EachRegistrar<Given, MakeRange> register_each_proof(const std::string& proof_name,
+                                                    std::string_view filename,
+                                                    uint32_t line_no,
+                                                    MakeRange make_range)
+{
+    return {proof_name, filename, line_no, std::move(make_range)};
+}
+
+// The random numbers ENSURE_FORALL generators draw from, splitmix64 so
+// that a seed gives the same cases everywhere
+class Random
+{
+public:
+    explicit Random(uint64_t seed) : state_(seed) { }
+
+    uint64_t next()
+    {
+        uint64_t z = (state_ += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, bound), or any value for a bound of 0
+    uint64_t below(uint64_t bound)
+    {
+        return bound == 0 ? next() : next() % bound;
+    }
+
+    // Uniform in [0, 1)
+    double unit()
+    {
+        return static_cast<double>(next() >> 11) * 0x1.0p-53;
+    }
+
+private:
+    uint64_t state_;
+};
+
+// What ENSURE_FORALL generates cases with: any callable taking a Random&.
+// Generators with a shrink(value) member returning simpler candidates
+// have failing cases shrunk to a minimal one.
+template <typename G>
+concept shrinking_generator = requires(const G& generator, Random& random) {
+    generator.shrink(generator(random));
+};
+
+namespace gen {
+
+// Integers in [lo, hi], drawn at the bounds and near zero more often than
+// uniformly. Shrinks toward the value in range closest to zero.
+template <std::integral T>
+struct Integers
+{
+    T lo;
+    T hi;
+
+    T operator()(Random& random) const
+    {
+        auto span = static_cast<uint64_t>(hi) - static_cast<uint64_t>(lo);
+        switch (random.below(8)) {
+        case 0: return lo;
+        case 1: return hi;
+        case 2: return target();
+        default: return static_cast<T>(static_cast<uint64_t>(lo) + random.below(span + 1));
+        }
+    }
+
+    T target() const
+    {
+        if constexpr (std::is_signed_v<T>) {
+            if (hi < 0) {
+                return hi;
+            }
+        }
+        return lo > 0 ? lo : T(0);
+    }
+
+    // The target and then values ever closer to value
+    std::vector<T> shrink(T value) const
+    {
+        std::vector<T> candidates;
+        auto to = target();
+        if (value == to) {
+            return candidates;
+        }
+        candidates.push_back(to);
+        // Halve the distance in unsigned arithmetic, which cannot overflow
+        bool down = value > to;
+        auto distance = down ? static_cast<uint64_t>(value) - static_cast<uint64_t>(to)
+                             : static_cast<uint64_t>(to) - static_cast<uint64_t>(value);
+        for (auto step = distance / 2; step > 0; step /= 2) {
+            candidates.push_back(static_cast<T>(down ? static_cast<uint64_t>(value) - step
+                                                     : static_cast<uint64_t>(value) + step));
+        }
+        return candidates;
+    }
+};
+
+template <std::integral T>
+Integers<T> integers(T lo = std::numeric_limits<T>::min(), T hi = std::numeric_limits<T>::max())
+{
+    return {lo, hi};
+}
+
+// Doubles uniform in [lo, hi). Shrinks toward zero, or the bound closest
+// to it, and to whole numbers.
+struct Doubles
+{
+    double lo;
+    double hi;
+
+    double operator()(Random& random) const
+    {
+        return lo + random.unit() * (hi - lo);
+    }
+
+    std::vector<double> shrink(double value) const
+    {
+        std::vector<double> candidates;
+        auto to = lo > 0 ? lo : (hi < 0 ? hi : 0.0);
+        for (auto candidate : {to, std::trunc(value), to + (value - to) / 2}) {
+            if (candidate != value && candidate >= lo && candidate < hi
+                && std::fabs(candidate - to) < std::fabs(value - to)) {
+                candidates.push_back(candidate);
+            }
+        }
+        return candidates;
+    }
+};
+
+inline Doubles doubles(double lo, double hi)
+{
+    return {lo, hi};
+}
+
+// Vectors of up to max_size elements of another generator. Shrinks by
+// dropping halves and single elements, then by shrinking elements.
+template <typename Element>
+struct Vectors
+{
+    Element element;
+    size_t max_size;
+
+    auto operator()(Random& random) const
+    {
+        std::vector<std::decay_t<decltype(element(random))>> values(random.below(max_size + 1));
+        for (auto& value : values) {
+            value = element(random);
+        }
+        return values;
+    }
+
+    template <typename V>
+    std::vector<V> shrink(const V& values) const
+    {
+        std::vector<V> candidates;
+        if (values.empty()) {
+            return candidates;
+        }
+        candidates.emplace_back();
+        auto half = values.size() / 2;
+        if (half > 0) {
+            candidates.emplace_back(values.begin(), values.begin() + static_cast<ptrdiff_t>(half));
+            candidates.emplace_back(values.begin() + static_cast<ptrdiff_t>(half), values.end());
+        }
+        for (size_t i = 0; i < values.size() && values.size() > 1; ++i) {
+            auto without = values;
+            without.erase(without.begin() + static_cast<ptrdiff_t>(i));
+            candidates.push_back(std::move(without));
+        }
+        if constexpr (shrinking_generator<Element>) {
+            for (size_t i = 0; i < values.size(); ++i) {
+                for (auto& simpler : element.shrink(values[i])) {
+                    auto changed = values;
+                    changed[i] = simpler;
+                    candidates.push_back(std::move(changed));
+                }
+            }
+        }
+        return candidates;
+    }
+};
+
+template <typename Element>
+Vectors<Element> vectors(Element element, size_t max_size)
+{
+    return {std::move(element), max_size};
+}
+
+// Strings of up to max_size printable ASCII characters, shrunk like
+// vectors and by replacing characters with 'a'
+struct Strings
+{
+    size_t max_size;
+
+    std::string operator()(Random& random) const
+    {
+        std::string value(random.below(max_size + 1), ' ');
+        for (auto& c : value) {
+            c = static_cast<char>(' ' + random.below(95));
+        }
+        return value;
+    }
+
+    std::vector<std::string> shrink(const std::string& value) const
+    {
+        // Characters that can't shrink, so that only the replacement below
+        // changes them
+        auto character = [](Random& random) { return static_cast<char>(' ' + random.below(95)); };
+        Vectors<decltype(character)> characters{character, max_size};
+        auto candidates = characters.shrink(value);
+        for (size_t i = 0; i < value.size(); ++i) {
+            if (value[i] != 'a') {
+                auto simpler = value;
+                simpler[i] = 'a';
+                candidates.push_back(std::move(simpler));
+            }
+        }
+        return candidates;
+    }
+};
+
+inline Strings strings(size_t max_size)
+{
+    return {max_size};
+}
+
+// One of the given values, shrinking toward the first
+template <typename T>
+struct Elements
+{
+    std::vector<T> values;
+
+    T operator()(Random& random) const
+    {
+        return values[random.below(values.size())];
+    }
+
+    std::vector<T> shrink(const T& value) const
+    {
+        auto it = std::find(values.begin(), values.end(), value);
+        return std::vector<T>(values.begin(), it);
+    }
+};
+
+template <typename T>
+Elements<T> elements(std::initializer_list<T> values)
+{
+    return {std::vector<T>(values)};
+}
+
+}
+
+// Shrinks a failing value one candidate at a time, taking the first
+// candidate that still fails until none does or max_steps candidates have
+// been tried
+template <typename G, typename T, typename F>
+T shrink_failure(const G& generator, T value, F&& fails, uint32_t max_steps = 1000)
+{
+    if constexpr (shrinking_generator<G>) {
+        uint32_t steps = 0;
+        for (bool progress = true; progress && steps < max_steps;) {
+            progress = false;
+            for (auto& candidate : generator.shrink(value)) {
+                if (++steps > max_steps) {
+                    break;
+                }
+                if (fails(candidate)) {
+                    value = std::move(candidate);
+                    progress = true;
+                    break;
+                }
+            }
+        }
+    }
+    return value;
+}
+
+// FORALL_SEED, or a fixed seed so that runs are repeatable
+inline uint64_t forall_seed()
+{
+    const char* seed = getenv("FORALL_SEED");
+    return seed ? std::strtoull(seed, nullptr, 10) : 0x5eed;
+}
+
+// Counterpart of ProofRegistrar for ENSURE_FORALL. Case i is generated
+// from its own seed, so a batch only generates its own cases. The first
+// failing case of a batch is shrunk and reported, and ends the batch.
+template <typename Given, typename Generator>
+struct ForallRegistrar
+{
+    std::string proof_name;
+    std::string_view filename;
+    uint32_t line_no;
+    Generator generator;
+    uint64_t cases;
+
+    template <typename F>
+    void operator=(F&& body)
+    {
+        auto shared = std::make_shared<std::decay_t<F>>(std::forward<F>(body));
+        auto batches = batches_for(cases);
+        for (uint32_t batch = 0; batch < batches; ++batch) {
+            auto& entry = add_proof_entry(case_batch_name(proof_name, batch, batches), filename, line_no);
+            entry.make_fixture = make_fixture<Given>;
+            entry.release_fixture = release_fixture<Given>;
+            entry.utest_wrapper = [shared, generator = generator, cases = cases, batch, batches,
+                                   filename = filename, line_no = line_no,
+                                   name_hash = std::hash<std::string>{}(proof_name)](BaseFixture* a) {
+                Given* utest_fixture_ = static_cast<Given*>(a);
+                utest_fixture_->set_up();
+                auto seed = forall_seed();
+                for (uint64_t index = batch; index < cases; index += batches) {
+                    Random random(seed ^ name_hash ^ (index * 0xd1b54a32d192ed03ull));
+                    auto value = generator(random);
+                    if (run_case(*utest_fixture_, *shared, value, filename, line_no)) {
+                        continue;
+                    }
+                    utest_fixture_->utest_take_failures();
+                    auto minimal = shrink_failure(generator, value, [&](const auto& candidate) {
+                        bool passed = run_case(*utest_fixture_, *shared, candidate, filename, line_no);
+                        utest_fixture_->utest_take_failures();
+                        return !passed;
+                    });
+                    run_case(*utest_fixture_, *shared, minimal, filename, line_no);
+                    std::vector<ProofFailure> failed;
+                    auto label = " [case " + std::to_string(index) + ": " + format_value(minimal);
+                    if constexpr (std::equality_comparable<decltype(value)>) {
+                        if (!(minimal == value)) {
+                            label += ", shrunk from " + format_value(value);
+                        }
+                    }
+                    label_failures(*utest_fixture_, failed, label + ", FORALL_SEED=" + std::to_string(seed) + "]");
+                    for (auto& failure : failed) {
+                        utest_fixture_->utest_put_failure(std::move(failure));
+                    }
+                    break;
+                }
+                utest_fixture_->tear_down();
+            };
+        }
+    }
+};
+
+template <typename Given, typename Generator>
+ForallRegistrar<Given, Generator> register_forall_proof(const std::string& proof_name,
+                                                        std::string_view filename,
+                                                        uint32_t line_no,
+                                                        Generator generator,
+                                                        uint64_t cases)
+{
+    return {proof_name, filename, line_no, std::move(generator), cases};
+}
+
+#define MODEL(suite_name) SUITE_GEN_UNIQUE(suite_name, __LINE__)
+#define SUITE(suite_name) SUITE_GEN_UNIQUE(suite_name, __LINE__)
+#define SUITE_GEN_UNIQUE(x, y) SUITE_INTERNAL(x, y)
+#define SUITE_INTERNAL(suite_name, unique_line) \
+    static void utest_suite ## unique_line(); \
+    namespace {bool reg ## unique_line = register_suite_function(suite_name, utest_suite ## unique_line);} \
+    static void utest_suite ## unique_line()
+
+// Marks the enclosing suite as one whose proofs must not run concurrently
+// with any other proof, e.g. because they bind fixed ports.
+#define SERIAL_SUITE() (utest_active_suite()->serial = true)
+
+#define ENSURE(what) ENSURE_GIVEN(what, EmptyFixture)
+#define ENSURE_GIVEN(what, given) register_proof<given>(what, __FILE__, __LINE__) = [=](given& fixture)
+
+// Proofs that fail, and end the run, when not finished within timeoutms
+#define ENSURE_WITHIN(what, timeoutms) ENSURE_GIVEN_WITHIN(what, EmptyFixture, timeoutms)
+#define ENSURE_GIVEN_WITHIN(what, given, timeoutms) register_proof<given>(what, __FILE__, __LINE__, timeoutms) = [=](given& fixture)
+
+// Parameterized proofs, the body runs for every element of the range as
+// param. The range is only evaluated when the proof runs.
+#define ENSURE_EACH(what, ...) ENSURE_GIVEN_EACH(what, EmptyFixture, __VA_ARGS__)
+#define ENSURE_GIVEN_EACH(what, given, ...) \
+    register_each_proof<given>(what, __FILE__, __LINE__, [=] { return __VA_ARGS__; }) \
+        = [=](given& fixture, const auto& param)
+
+// Property-based proofs, the body runs for cases values of the generator
+// as param, e.g. ENSURE_FORALL("...", gen::integers(0, 100), 1000)
+#define ENSURE_FORALL(what, generator, cases) ENSURE_GIVEN_FORALL(what, EmptyFixture, generator, cases)
+#define ENSURE_GIVEN_FORALL(what, given, generator, cases) \
+    register_forall_proof<given>(what, __FILE__, __LINE__, generator, cases) \
+        = [=](given& fixture, const auto& param)
+
+// Benchmark proofs, the body is run repeatedly and reported as ns/op
+#define MEASURE(what) MEASURE_GIVEN(what, EmptyFixture)
+#define MEASURE_GIVEN(what, given) register_benchmark<given>(what, __FILE__, __LINE__) = [=](given& fixture)
+
+// Stress proofs, the body runs iterations times on each of threads threads
+// that start together. It is passed the StressThread running it as thread.
+#define ENSURE_CONCURRENTLY(what, threads, iterations) ENSURE_GIVEN_CONCURRENTLY(what, EmptyFixture, threads, iterations)
+#define ENSURE_GIVEN_CONCURRENTLY(what, given, threads, iterations) \
+    register_concurrent_proof<given>(what, __FILE__, __LINE__, threads, iterations) \
+        = [=](given& fixture, [[maybe_unused]] StressThread& thread)
+
+#define ASSERT(pred) fixture.utest_assert((pred) ? true : false, __FILE__, __LINE__, #pred)
+// Note: actual and expected might be expressions that need to be evaluated
+// and can thus not be passed to utest_assert_eq directly.
+#define ASSERT_EQ(actual, expected) ([&]{auto&& _utest_a=actual;auto&& _utest_e=expected; return fixture.utest_assert_eq(_utest_a, _utest_e, __FILE__,  __LINE__, #actual, #expected);}())
+// Comparisons of large buffers and containers that report where they
+// first differ instead of printing both values in full
+#define ASSERT_BYTES_EQ(actual, expected) ([&]{auto&& _utest_a=actual;auto&& _utest_e=expected; return fixture.utest_assert_bytes_eq(_utest_a, _utest_e, __FILE__,  __LINE__, #actual, #expected);}())
+#define ASSERT_RANGE_EQ(actual, expected) ([&]{auto&& _utest_a=actual;auto&& _utest_e=expected; return fixture.utest_assert_range_eq(_utest_a, _utest_e, __FILE__,  __LINE__, #actual, #expected);}())
+// Floating point comparisons with a tolerance given as an absolute
+// difference or a Tolerance
+#define ASSERT_NEAR(actual, expected, tolerance) ([&]{auto&& _utest_a=actual;auto&& _utest_e=expected; return fixture.utest_assert_near(_utest_a, _utest_e, tolerance, __FILE__,  __LINE__, #actual, #expected);}())
+#define ASSERT_ARRAY_NEAR(actual, expected, tolerance) ([&]{auto&& _utest_a=actual;auto&& _utest_e=expected; return fixture.utest_assert_array_near(_utest_a, _utest_e, tolerance, __FILE__,  __LINE__, #actual, #expected);}())
+// Latency assertions on a LatencyHistogram or the name of one. Limits are
+// std::chrono durations, e.g. ASSERT_P99_BELOW("rpc", 200us).
+#define ASSERT_PERCENTILE_BELOW(histogram, percent, limit) fixture.utest_assert_percentile_below(histogram, percent, limit, __FILE__, __LINE__, #histogram)
+#define ASSERT_P99_BELOW(histogram, limit) ASSERT_PERCENTILE_BELOW(histogram, 99, limit)
+// Checks that the statements, e.g. ASSERT_NO_ALLOC({ queue.push(1); }),
+// don't allocate on this thread. Needs utest_alloc.cpp to be linked in.
+#define ASSERT_MAX_ALLOCS(max, ...) fixture.utest_assert_max_allocs(max, [&](){__VA_ARGS__;}, __FILE__, __LINE__, #__VA_ARGS__)
+#define ASSERT_NO_ALLOC(...) ASSERT_MAX_ALLOCS(0, __VA_ARGS__)
+#define ASSERT_THROW(statement, exception) fixture.utest_assert_throw<exception>([&](){statement}, __FILE__, __LINE__, #exception)
+#define ASSERT_NO_THROW(statement) fixture.utest_assert_no_throw([&](){statement}, __FILE__, __LINE__)
+
+#define TRY_ASSERT(pred, timeoutms) fixture.utest_poll([&](bool utest_report_) { \
+    return fixture.utest_assert((pred) ? true : false, __FILE__, __LINE__, #pred, utest_report_);}, timeoutms)
+
+#define TRY_ASSERT_EQ(actual, expected, timeoutms) fixture.utest_poll([&](bool utest_report_) { \
+    auto&& _utest_a=actual; \
+    auto&& _utest_e=expected; \
+    return fixture.utest_assert_eq(_utest_a, _utest_e, __FILE__,  __LINE__, #actual, #expected, utest_report_);}, timeoutms)
+
+#define TRY_ASSERT_THROW(statement, exception, timeoutms) fixture.utest_poll([&](bool utest_report_) { \
+    return fixture.utest_assert_throw<exception>([&](){statement}, __FILE__, __LINE__, #exception, utest_report_);}, timeoutms)
+
+#define TRY_ASSERT_NO_THROW(statement, timeoutms) fixture.utest_poll([&](bool utest_report_) { \
+    return fixture.utest_assert_no_throw([&](){statement}, __FILE__, __LINE__, utest_report_);}, timeoutms)
+
+
+inline std::vector<SuiteEntry>& utest_suites()
+{
+    static std::vector<SuiteEntry> _s;
+    return _s;
+}
+
+inline std::vector<ProofEntry>& utest_proofs()
+{
+    static std::vector<ProofEntry> _p;
+    return _p;
+}
+
+inline SuiteEntry*& utest_active_suite()
+{
+    static SuiteEntry* _s = nullptr;
+    return _s;
+}
+
+inline std::vector<ProofFailure>& proof_failures()
+{
+    static std::vector<ProofFailure> _f;
+    return _f;
+}
+
+inline std::vector<BenchmarkResult>& benchmark_results()
+{
+    static std::vector<BenchmarkResult> _b;
+    return _b;
+}
+
+inline std::vector<StressResult>& stress_results()
+{
+    static std::vector<StressResult> _s;
+    return _s;
+}
+
+inline std::vector<ProofResult>& slowest_proofs()
+{
+    static std::vector<ProofResult> _s;
+    return _s;
+}
+
+// Used for error reporting uncaught exceptions
+inline std::string current_proof;
+
+inline bool register_suite_function(const char* name, std::function<void()> suite_function)
+{
+    // Only for finding the suite, the order is kept by utest_suites()
+    static std::unordered_map<std::string, size_t> index;
+    auto& suites = utest_suites();
+    auto [it, added] = index.try_emplace(name, suites.size());
+    if (added) {
+        suites.push_back(SuiteEntry{name, {}});
+    }
+    suites[it->second].functions.push_back(std::move(suite_function));
+    return true;
+}
+
+inline size_t suite_count()
+{
+    return utest_suites().size();
+}
+
+// This process' share of a run split across machines, from SHARD_INDEX and
+// SHARD_COUNT or the GTest equivalents GTEST_SHARD_INDEX and
+// GTEST_TOTAL_SHARDS.
+struct ShardSpec
+{
+    uint32_t index = 0;
+    uint32_t count = 1;
+};
+
+inline ShardSpec env_shard()
+{
+    const char* index = getenv("SHARD_INDEX");
+    const char* count = getenv("SHARD_COUNT");
+    if (!index || !count) {
+        index = getenv("GTEST_SHARD_INDEX");
+        count = getenv("GTEST_TOTAL_SHARDS");
+    }
+    if (!index || !count) {
+        return {};
+    }
+    ShardSpec shard{static_cast<uint32_t>(std::strtoul(index, nullptr, 10)),
+                    static_cast<uint32_t>(std::strtoul(count, nullptr, 10))};
+    if (shard.count == 0 || shard.index >= shard.count) {
+        throw std::invalid_argument("Shard index " + std::to_string(shard.index)
+                                    + " is out of range for " + std::to_string(shard.count) + " shards");
+    }
+    return shard;
+}
+
+// The comma separated files in RESULTS_FILE, with the shard suffix when
+// sharding (see merge_results_files)
+inline std::vector<std::filesystem::path> results_file_paths()
+{
+    std::vector<std::filesystem::path> paths;
+    const auto res_file = getenv("RESULTS_FILE");
+    if (!res_file) {
+        return paths;
+    }
+
+    auto shard = env_shard();
+    std::string_view files(res_file);
+    while (!files.empty()) {
+        auto comma = std::min(files.find(','), files.size());
+        std::filesystem::path res_file_path(files.substr(0, comma));
+        files.remove_prefix(std::min(comma + 1, files.size()));
+        if (res_file_path.empty()) {
+            continue;
+        }
+        if (shard.count > 1) {
+            res_file_path.replace_filename(res_file_path.stem().string()
+                                           + ".shard-" + std::to_string(shard.index)
+                                           + "-of-" + std::to_string(shard.count)
+                                           + res_file_path.extension().string());
+        }
+        paths.push_back(std::move(res_file_path));
+    }
+    return paths;
+}
+
+// Little-endian, length-prefixed encoding used to pass results between
+// processes and for binary results files.
+class BinaryWriter
+{
+public:
+    void u8(uint8_t value)
+    {
+        data_.push_back(static_cast<char>(value));
+    }
+
+    void u32(uint32_t value)
+    {
+        for (int32_t i = 0; i < 4; ++i) {
+            u8(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    void u64(uint64_t value)
+    {
+        for (int32_t i = 0; i < 8; ++i) {
+            u8(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    void i64(int64_t value)
+    {
+        u64(static_cast<uint64_t>(value));
+    }
+
+    void f64(double value)
+    {
+        u64(std::bit_cast<uint64_t>(value));
+    }
+
+    void str(std::string_view value)
+    {
+        u32(static_cast<uint32_t>(value.size()));
+        data_.append(value);
+    }
+
+    const std::string& data() const
+    {
+        return data_;
+    }
+
+private:
+    std::string data_;
+};
+
+// Counterpart of BinaryWriter. Reading past the end yields zeroes and
+// clears ok().
+class BinaryReader
+{
+public:
+    explicit BinaryReader(std::string_view data) :
+        data_(data)
+    { }
+
+    uint8_t u8()
+    {
+        if (pos_ >= data_.size()) {
+            ok_ = false;
+            return 0;
+        }
+        return static_cast<uint8_t>(data_[pos_++]);
+    }
+
+    uint32_t u32()
+    {
+        uint32_t value = 0;
+        for (int32_t i = 0; i < 4; ++i) {
+            value |= static_cast<uint32_t>(u8()) << (8 * i);
+        }
+        return value;
+    }
+
+    uint64_t u64()
+    {
+        uint64_t value = 0;
+        for (int32_t i = 0; i < 8; ++i) {
+            value |= static_cast<uint64_t>(u8()) << (8 * i);
+        }
+        return value;
+    }
+
+    int64_t i64()
+    {
+        return static_cast<int64_t>(u64());
+    }
+
+    double f64()
+    {
+        return std::bit_cast<double>(u64());
+    }
+
+    std::string str()
+    {
+        auto size = u32();
+        if (size > data_.size() - std::min(pos_, data_.size())) {
+            ok_ = false;
+            return {};
+        }
+        std::string value(data_.substr(pos_, size));
+        pos_ += size;
+        return value;
+    }
+
+    bool ok() const
+    {
+        return ok_;
+    }
+
+private:
+    std::string_view data_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+};
+
+inline void encode_failure(BinaryWriter& out, const ProofFailure& failure)
+{
+    out.str(failure.suite_name);
+    out.str(failure.proof_name);
+    out.str(failure.filename);
+    out.u32(failure.line_no);
+    out.str(failure.test);
+    out.str(failure.actual);
+    out.str(failure.expected);
+    out.str(failure.actual_str);
+}
+
+inline ProofFailure decode_failure(BinaryReader& in)
+{
+    ProofFailure failure;
+    failure.suite_name = in.str();
+    failure.proof_name = in.str();
+    failure.filename = in.str();
+    failure.line_no = in.u32();
+    failure.test = in.str();
+    failure.actual = in.str();
+    failure.expected = in.str();
+    failure.actual_str = in.str();
+    return failure;
+}
+
+inline void encode_result(BinaryWriter& out, const ProofResult& result, const std::vector<ProofFailure>& failures)
+{
+    out.str(result.suite_name);
+    out.str(result.proof_name);
+    out.str(result.type);
+    out.u8(result.passed);
+    out.i64(result.wall_ns);
+    out.i64(result.cpu_ns);
+    out.i64(result.max_rss_delta_kb);
+    out.u64(result.allocations);
+    out.u64(result.allocated_bytes);
+    out.u32(static_cast<uint32_t>(result.perf_counters.size()));
+    for (auto& [name, count] : result.perf_counters) {
+        out.str(name);
+        out.u64(count);
+    }
+    out.u32(static_cast<uint32_t>(failures.size()));
+    for (auto& failure : failures) {
+        encode_failure(out, failure);
+    }
+}
+
+inline void decode_result(BinaryReader& in, ProofResult& result, std::vector<ProofFailure>& failures)
+{
+    result.suite_name = in.str();
+    result.proof_name = in.str();
+    result.type = in.str();
+    result.passed = in.u8() != 0;
+    result.wall_ns = in.i64();
+    result.cpu_ns = in.i64();
+    result.max_rss_delta_kb = in.i64();
+    result.allocations = in.u64();
+    result.allocated_bytes = in.u64();
+    for (auto n = in.u32(); n > 0 && in.ok(); --n) {
+        auto name = in.str();
+        result.perf_counters.emplace_back(std::move(name), in.u64());
+    }
+    for (auto n = in.u32(); n > 0 && in.ok(); --n) {
+        failures.push_back(decode_failure(in));
+    }
+}
+
+inline std::string failure_message(const ProofFailure& failure)
+{
+    return failure.test + " (expected '" + failure.actual_str + "' to be " + failure.expected
+           + ", actual = " + failure.actual + ")";
+}
+
+inline void append_json_string(std::string& out, std::string_view value)
+{
+    out += '"';
+    for (char c : value) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                static constexpr char hex[] = "0123456789abcdef";
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0xf];
+            }
+            else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+
+// Control characters other than whitespace can't appear in XML 1.0 at all
+// and are replaced with '?'
+inline void append_xml_escaped(std::string& out, std::string_view value)
+{
+    for (char c : value) {
+        switch (c) {
+        case '&': out += "&amp;"; break;
+        case '<': out += "&lt;"; break;
+        case '>': out += "&gt;"; break;
+        case '"': out += "&quot;"; break;
+        case '\'': out += "&apos;"; break;
+        case '\t':
+        case '\n':
+        case '\r': out += c; break;
+        default: out += static_cast<unsigned char>(c) < 0x20 ? '?' : c;
+        }
+    }
+}
+
+// Formats the results written to a results file, see ResultsStream. A
+// result and the failures of its proof are formatted on their own as soon
+// as the proof finishes, so formats that need totals up front don't fit.
+class Reporter
+{
+public:
+    virtual ~Reporter() = default;
+
+    // Written when the file is opened
+    virtual void begin(std::string& /*out*/) { }
+
+    virtual void add(std::string& out, const ProofResult& result, const std::vector<ProofFailure>& failures) = 0;
+
+    // Written for every MEASURE block before the file is closed
+    virtual void add_benchmark(std::string& /*out*/, const BenchmarkResult& /*result*/) { }
+
+    // Written when the file is closed at the end of a run
+    virtual void end(std::string& /*out*/) { }
+};
+
+// A JSON array with one object per line, or JSON Lines without the array
+class JsonReporter : public Reporter
+{
+public:
+    explicit JsonReporter(bool json_lines) :
+        json_lines_(json_lines)
+    { }
+
+    void begin(std::string& out) override
+    {
+        if (!json_lines_) {
+            out += "[\n";
+        }
+    }
+
+    void add(std::string& out, const ProofResult& result, const std::vector<ProofFailure>& /*failures*/) override
+    {
+        if (!json_lines_) {
+            out += count_ > 0 ? ",\n  " : "  ";
+        }
+        count_ += 1;
+
+        out += "{\"type\": ";
+        append_json_string(out, result.type);
+        out += ", \"name\": ";
+        append_json_string(out, result.suite_name + "::" + result.proof_name);
+        out += ", \"passed\": ";
+        out += result.passed ? "true" : "false";
+        out += ", \"wall_ns\": " + std::to_string(result.wall_ns)
+               + ", \"cpu_ns\": " + std::to_string(result.cpu_ns)
+               + ", \"max_rss_delta_kb\": " + std::to_string(result.max_rss_delta_kb);
+        if (allocation_tracking) {
+            out += ", \"allocations\": " + std::to_string(result.allocations)
+                   + ", \"allocated_bytes\": " + std::to_string(result.allocated_bytes);
+        }
+        // Flat keys, which read_results_file() can read
+        for (auto& [name, count] : result.perf_counters) {
+            out += ", ";
+            append_json_string(out, "perf_" + name);
+            out += ": " + std::to_string(count);
+        }
+        out += "}";
+        if (json_lines_) {
+            out += "\n";
+        }
+    }
+
+    // Benchmarks are objects with their samples, which read_benchmarks()
+    // reads back as a baseline
+    void add_benchmark(std::string& out, const BenchmarkResult& result) override
+    {
+        if (!json_lines_) {
+            out += count_ > 0 ? ",\n  " : "  ";
+        }
+        count_ += 1;
+
+        out += "{\"type\": \"samples\", \"name\": ";
+        append_json_string(out, result.suite_name + "::" + result.proof_name);
+        out += ", \"iterations\": " + std::to_string(result.iterations);
+        for (auto [key, value] : {std::pair{", \"min_ns\": ", result.min_ns},
+                                  std::pair{", \"median_ns\": ", result.median_ns},
+                                  std::pair{", \"p99_ns\": ", result.p99_ns}}) {
+            out += key;
+            format_value(out, value);
+        }
+        for (auto& [name, per_op] : result.perf_per_op) {
+            out += ", ";
+            append_json_string(out, "perf_" + name + "_per_op");
+            out += ": ";
+            format_value(out, per_op);
+        }
+        out += ", \"samples\": [";
+        for (size_t i = 0; i < result.samples.size(); ++i) {
+            out += i > 0 ? ", " : "";
+            format_value(out, result.samples[i]);
+        }
+        out += "]}";
+        if (json_lines_) {
+            out += "\n";
+        }
+    }
+
+    void end(std::string& out) override
+    {
+        if (!json_lines_) {
+            out += count_ > 0 ? "\n]\n" : "]\n";
+        }
+    }
+
+private:
+    bool json_lines_;
+    size_t count_ = 0;
+};
+
+// JUnit XML as read by CI servers. Every proof is a testcase of a single
+// testsuite, with the suite name as its classname; the totals JUnit can
+// carry on the testsuite element are left out since they aren't known
+// until the end.
+class JunitReporter : public Reporter
+{
+public:
+    void begin(std::string& out) override
+    {
+        out += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n  <testsuite name=\"utest\">\n";
+    }
+
+    void add(std::string& out, const ProofResult& result, const std::vector<ProofFailure>& failures) override
+    {
+        out += "    <testcase classname=\"";
+        append_xml_escaped(out, result.suite_name);
+        out += "\" name=\"";
+        append_xml_escaped(out, result.proof_name);
+        out += "\" time=\"" + std::to_string(static_cast<double>(result.wall_ns) / 1e9) + "\"";
+        if (failures.empty() && result.passed) {
+            out += "/>\n";
+            return;
+        }
+
+        out += ">\n";
+        for (auto& failure : failures) {
+            out += "      <failure message=\"";
+            append_xml_escaped(out, failure_message(failure));
+            out += "\" type=\"";
+            append_xml_escaped(out, failure.test);
+            out += "\">";
+            append_xml_escaped(out, failure.filename + ":" + std::to_string(failure.line_no));
+            out += "</failure>\n";
+        }
+        if (failures.empty()) {
+            out += "      <failure message=\"failed\"/>\n";
+        }
+        out += "    </testcase>\n";
+    }
+
+    void end(std::string& out) override
+    {
+        out += "  </testsuite>\n</testsuites>\n";
+    }
+};
+
+// A compact format for tools reading large numbers of results: the 8 byte
+// magic "UTESTRES" and a u32 version, followed by one record per proof. A
+// record is its u32 size and then encode_result() of the result and its
+// failures, so a reader can skip from record to record in a mapped file.
+class BinaryReporter : public Reporter
+{
+public:
+    static constexpr std::string_view magic = "UTESTRES";
+    static constexpr uint32_t version = 3;
+
+    void begin(std::string& out) override
+    {
+        BinaryWriter header;
+        header.u32(version);
+        out += magic;
+        out += header.data();
+    }
+
+    void add(std::string& out, const ProofResult& result, const std::vector<ProofFailure>& failures) override
+    {
+        BinaryWriter record;
+        encode_result(record, result, failures);
+        BinaryWriter size;
+        size.u32(static_cast<uint32_t>(record.data().size()));
+        out += size.data();
+        out += record.data();
+    }
+};
+
+// The reporter for a results file by its extension: .xml for JUnit XML,
+// .bin for the binary format, .jsonl for JSON Lines and JSON otherwise.
+inline std::unique_ptr<Reporter> make_reporter(const std::filesystem::path& path)
+{
+    auto extension = path.extension();
+    if (extension == ".xml") {
+        return std::make_unique<JunitReporter>();
+    }
+    if (extension == ".bin") {
+        return std::make_unique<BinaryReporter>();
+    }
+    return std::make_unique<JsonReporter>(extension == ".jsonl");
+}
+
+// Functions run from a fatal signal handler, before the signal is raised
+// again, to get buffered output out of a crashing process. They must not
+// allocate or lock.
+inline std::atomic<void (*)()> crash_flushers[4];
+
+inline void run_crash_flushers(int signal)
+{
+    for (auto& flusher : crash_flushers) {
+        if (auto flush = flusher.load()) {
+            flush();
+        }
+    }
+    std::signal(signal, SIG_DFL);
+    std::raise(signal);
+}
+
+inline void add_crash_flusher(void (*flush)())
+{
+    for (auto& flusher : crash_flushers) {
+        void (*expected)() = nullptr;
+        if (flusher.compare_exchange_strong(expected, flush) || expected == flush) {
+            break;
+        }
+    }
+    for (int signal : {SIGABRT, SIGFPE, SIGILL, SIGSEGV}) {
+        std::signal(signal, run_crash_flushers);
+    }
+}
+
+inline void clear_crash_flushers()
+{
+    for (auto& flusher : crash_flushers) {
+        flusher = nullptr;
+    }
+}
+
+#if defined(UTEST_POSIX)
+// Batches std::cout when stdout isn't a terminal. Unlike a stdio buffer,
+// what it holds can be written out from a signal handler: flush_on_crash()
+// only calls write(2) and takes no lock.
+class StdoutBuffer : public std::streambuf
+{
+public:
+    StdoutBuffer()
+    {
+        setp(buffer_, buffer_ + sizeof(buffer_));
+    }
+
+    void flush_on_crash()
+    {
+        write_out(pbase(), static_cast<size_t>(pptr() - pbase()));
+    }
+
+protected:
+    int_type overflow(int_type c) override
+    {
+        if (sync() != 0) {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override
+    {
+        bool written = write_out(pbase(), static_cast<size_t>(pptr() - pbase()));
+        setp(buffer_, buffer_ + sizeof(buffer_));
+        return written ? 0 : -1;
+    }
+
+private:
+    static bool write_out(const char* data, size_t size)
+    {
+        while (size > 0) {
+            auto n = write(STDOUT_FILENO, data, size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    char buffer_[64 * 1024];
+};
+
+// Never destroyed, std::cout is flushed after static objects are gone
+inline StdoutBuffer& stdout_buffer()
+{
+    static auto* buffer = new StdoutBuffer;
+    return *buffer;
+}
+
+inline void flush_stdout()
+{
+    stdout_buffer().flush_on_crash();
+}
+#endif
+
+inline bool stdout_is_terminal()
+{
+#if defined(UTEST_POSIX)
+    return isatty(STDOUT_FILENO) != 0;
+#else
+    return true;
+#endif
+}
+
+// Output while proofs run. It goes through std::cout, in order with what
+// proofs print themselves, but isn't flushed for every line: a terminal is
+// flushed as lines are written so it stays live, anything else only every
+// 200 ms and when a proof fails. utest_main gives a piped stdout a 64 kB
+// buffer for this. PROGRESS replaces the line per proof with a progress bar,
+// or a line per tenth of the run when not on a terminal, and Q prints
+// nothing.
+class ConsoleReporter
+{
+public:
+    enum class Mode
+    {
+        lines,
+        progress,
+        quiet
+    };
+
+    ConsoleReporter(Mode mode, bool live) :
+        mode_(mode),
+        live_(live),
+        last_flush_(std::chrono::steady_clock::now())
+    { }
+
+    Mode mode() const
+    {
+        return mode_;
+    }
+
+    bool live() const
+    {
+        return live_;
+    }
+
+    void start(size_t total)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        total_ = total;
+    }
+
+    void suite(std::string_view name)
+    {
+        if (mode_ == Mode::lines) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::cout << "== " << name << " ==\n";
+            written();
+        }
+    }
+
+    void proof(std::string_view name)
+    {
+        if (mode_ == Mode::lines) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::cout << " * " << name << '\n';
+            written();
+        }
+    }
+
+    void finished(const ProofResult& result)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ += 1;
+        failed_ += result.passed ? 0 : 1;
+        if (mode_ == Mode::progress) {
+            if (!result.passed) {
+                clear_bar();
+                std::cout << " ! " << result.suite_name << "::" << result.proof_name << " failed\n";
+            }
+            progress(!result.passed);
+        }
+        if (!result.passed) {
+            flush_locked();
+        }
+    }
+
+    // Ends the progress bar line and writes out what is buffered, for output
+    // that doesn't go through here
+    void flush()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (bar_shown_) {
+            std::cout << '\n';
+            bar_shown_ = false;
+        }
+        flush_locked();
+    }
+
+private:
+    void written()
+    {
+        if (live_ || std::chrono::steady_clock::now() - last_flush_ >= std::chrono::milliseconds(200)) {
+            flush_locked();
+        }
+    }
+
+    void flush_locked()
+    {
+        std::cout.flush();
+        last_flush_ = std::chrono::steady_clock::now();
+    }
+
+    void clear_bar()
+    {
+        if (bar_shown_) {
+            std::cout << "\r\033[K";
+            bar_shown_ = false;
+        }
+    }
+
+    void progress(bool redraw)
+    {
+        if (total_ == 0) {
+            return;
+        }
+        if (!live_) {
+            auto tenths = done_ * 10 / total_;
+            if (tenths > tenths_shown_) {
+                tenths_shown_ = tenths;
+                std::cout << "Progress: " << done_ << "/" << total_ << " proofs, " << failed_ << " failed\n";
+                written();
+            }
+            return;
+        }
+
+        // Redrawn at most every 50 ms, the bar would cost more than the proofs
+        auto now = std::chrono::steady_clock::now();
+        if (!redraw && done_ < total_ && bar_shown_ && now - last_flush_ < std::chrono::milliseconds(50)) {
+            return;
+        }
+        constexpr size_t width = 40;
+        auto filled = std::min(done_, total_) * width / total_;
+        std::cout << "\r[" << std::string(filled, '#') << std::string(width - filled, '.') << "] "
+                  << done_ << "/" << total_;
+        if (failed_ > 0) {
+            std::cout << ", " << failed_ << " failed";
+        }
+        bar_shown_ = true;
+        flush_locked();
+    }
+
+    Mode mode_;
+    bool live_;
+    std::mutex mutex_;
+    size_t total_ = 0;
+    size_t done_ = 0;
+    size_t failed_ = 0;
+    size_t tenths_shown_ = 0;
+    bool bar_shown_ = false;
+    std::chrono::steady_clock::time_point last_flush_;
+};
+
+inline ConsoleReporter& console()
+{
+    static ConsoleReporter reporter(getenv("Q")          ? ConsoleReporter::Mode::quiet
+                                    : getenv("PROGRESS") ? ConsoleReporter::Mode::progress
+                                                         : ConsoleReporter::Mode::lines,
+                                    stdout_is_terminal());
+    return reporter;
+}
+
+// Writes results to a results file as they are registered, so a crashed or
+// killed run still leaves the results so far and a dashboard can follow
+// progress. Output is batched and written out every 64 kB, every 200 ms and
+// for every failed proof. The format is up to the reporter, by default the
+// one for the file's extension. Callers hold proof_results_mutex.
+class ResultsStream
+{
+public:
+    explicit ResultsStream(const std::filesystem::path& path, std::unique_ptr<Reporter> reporter = nullptr) :
+        path_(path),
+        reporter_(reporter ? std::move(reporter) : make_reporter(path)),
+        file_(std::fopen(path.string().c_str(), "wb")),
+        last_flush_(std::chrono::steady_clock::now())
+    {
+        reporter_->begin(buffer_);
+    }
+
+    ~ResultsStream()
+    {
+        if (file_) {
+            std::fclose(file_);
+        }
+    }
+
+    ResultsStream(const ResultsStream&) = delete;
+    ResultsStream& operator=(const ResultsStream&) = delete;
+
+    const std::filesystem::path& path() const
+    {
+        return path_;
+    }
+
+    void append(const ProofResult& result, const std::vector<ProofFailure>& failures = {})
+    {
+        reporter_->add(buffer_, result, failures);
+        if (!result.passed || buffer_.size() >= 64 * 1024
+            || std::chrono::steady_clock::now() - last_flush_ >= std::chrono::milliseconds(200)) {
+            flush();
+        }
+    }
+
+    void append_benchmark(const BenchmarkResult& result)
+    {
+        reporter_->add_benchmark(buffer_, result);
+    }
+
+    void flush()
+    {
+        if (file_) {
+            std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+            std::fflush(file_);
+        }
+        buffer_.clear();
+        last_flush_ = std::chrono::steady_clock::now();
+    }
+
+    void close()
+    {
+        if (!file_) {
+            return;
+        }
+        reporter_->end(buffer_);
+        flush();
+        std::fclose(std::exchange(file_, nullptr));
+    }
+
+    // Writes out the current batch from a fatal signal handler
+    void flush_on_crash()
+    {
+        if (file_) {
+#if defined(UTEST_POSIX)
+            if (write(fileno(file_), buffer_.data(), buffer_.size()) < 0) {
+                return;
+            }
+#else
+            std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+            std::fflush(file_);
+#endif
+        }
+    }
+
+private:
+    std::filesystem::path path_;
+    std::unique_ptr<Reporter> reporter_;
+    std::FILE* file_;
+    std::string buffer_;
+    std::chrono::steady_clock::time_point last_flush_;
+};
+
+// Opened on the first result, so a HISTORY_FILE naming the results file of
+// the previous run is read before it is overwritten
+inline std::vector<std::unique_ptr<ResultsStream>>& results_streams()
+{
+    static std::vector<std::unique_ptr<ResultsStream>> streams = [] {
+        std::vector<std::unique_ptr<ResultsStream>> opened;
+        for (auto& path : results_file_paths()) {
+            opened.push_back(std::make_unique<ResultsStream>(path));
+        }
+        if (!opened.empty()) {
+            add_crash_flusher([] {
+                for (auto& stream : results_streams()) {
+                    stream->flush_on_crash();
+                }
+            });
+        }
+        return opened;
+    }();
+    return streams;
+}
+
+// Number of slowest proofs to keep for the summary, from SLOWEST (5)
+inline size_t slowest_count()
+{
+    static const size_t count = [] {
+        const char* slowest_env = getenv("SLOWEST");
+        return slowest_env ? static_cast<size_t>(std::strtoul(slowest_env, nullptr, 10)) : 5;
+    }();
+    return count;
+}
+
+// FAIL_FAST=1 stops a run at its first failed proof. Proofs that are
+// already running finish, those not started yet are counted as not run.
+inline bool fail_fast()
+{
+    static const bool enabled = [] {
+        const char* fail_fast_env = getenv("FAIL_FAST");
+        return fail_fast_env && std::string_view(fail_fast_env) != "0";
+    }();
+    return enabled;
+}
+
+inline constinit std::atomic<bool> run_stopped = false;
+inline constinit std::atomic<size_t> proofs_not_run = 0;
+
+// Under RERUN, the proofs that failed in the previous run and have not run
+// again yet. They are written to the results files as failed so that the
+// next RERUN still has them when FAIL_FAST or a filter left them out.
+inline std::map<std::string, ProofResult>& carried_failures()
+{
+    static std::map<std::string, ProofResult> failures;
+    return failures;
+}
+
+// Whether a proof about to start is to be skipped, counting it if so
+inline bool skip_stopped_proof()
+{
+    if (!run_stopped) {
+        return false;
+    }
+    proofs_not_run += 1;
+    return true;
+}
+
+// Results are streamed out rather than kept, only the slowest proofs are
+// held on to so memory stays flat however many proofs run.
+inline void register_proof_result(ProofResult result, const std::vector<ProofFailure>& failures = {})
+{
+    std::lock_guard<std::mutex> lock(proof_results_mutex);
+    if (!result.passed && fail_fast()) {
+        run_stopped = true;
+    }
+    if (!carried_failures().empty()) {
+        carried_failures().erase(result.suite_name + "::" + result.proof_name);
+    }
+    for (auto& stream : results_streams()) {
+        stream->append(result, failures);
+    }
+    console().finished(result);
+
+    auto& slowest = slowest_proofs();
+    auto by_wall_time = [](const ProofResult& a, const ProofResult& b) { return a.wall_ns > b.wall_ns; };
+    if (slowest.size() < slowest_count() || (!slowest.empty() && by_wall_time(result, slowest.back()))) {
+        slowest.insert(std::upper_bound(slowest.begin(), slowest.end(), result, by_wall_time), std::move(result));
+        if (slowest.size() > slowest_count()) {
+            slowest.pop_back();
+        }
+    }
+}
+
+inline int64_t thread_cpu_time_ns()
+{
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#else
+    return static_cast<int64_t>(std::clock() * (1e9 / CLOCKS_PER_SEC));
+#endif
+}
+
+// Peak resident set size of the process so far, 0 where unavailable
+inline int64_t max_rss_kb()
+{
+#if defined(UTEST_POSIX)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return 0;
+#endif
+}
+
+inline void populate_suite_proofs()
+{
+    auto& proofs = utest_proofs();
+    for (auto& suite : utest_suites()) {
+        utest_active_suite() = &suite;
+        auto first = proofs.size();
+        for (auto& suite_function : suite.functions) {
+            suite_function();
+        }
+        if (suite.serial) {
+            for (auto i = first; i < proofs.size(); ++i) {
+                proofs[i].serial = true;
+            }
+        }
+    }
+    utest_active_suite() = nullptr;
+}
+
+// Work-stealing pool used by the parallel runner. Each worker takes tasks
+// from the front of its own queue and, once that runs dry, steals from the
+// back of the other workers' queues.
+template <typename Task>
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(uint32_t workers) :
+        queues_(std::max<uint32_t>(workers, 1))
+    { }
+
+    uint32_t size() const
+    {
+        return static_cast<uint32_t>(queues_.size());
+    }
+
+    void push(uint32_t worker, Task task)
+    {
+        auto& queue = queues_[worker % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    // Runs execute(worker, task) on size() threads until every queue is
+    // empty or stop() has been called.
+    template <typename F>
+    void run(F&& execute)
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(queues_.size());
+        for (uint32_t worker = 0; worker < queues_.size(); ++worker) {
+            threads.emplace_back([this, &execute, worker] {
+                Task task;
+                while (!stopped_ && next(worker, task)) {
+                    execute(worker, task);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    void stop()
+    {
+        stopped_ = true;
+    }
+
+private:
+    bool next(uint32_t worker, Task& task)
+    {
+        {
+            auto& own = queues_[worker];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.front());
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues_.size(); ++i) {
+            auto& victim = queues_[(worker + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<Queue> queues_;
+    std::atomic<bool> stopped_ = false;
+};
+
+// Number of worker threads requested through JOBS=N, -j N, -jN, --jobs N
+// or --jobs=N. A value of 0 (or a bare -j) means one worker per hardware
+// thread. Other arguments, e.g. -json, are left to the binary.
+inline uint32_t job_count(int argc, char* argv[])
+{
+    auto digits = [](std::string_view text) {
+        return !text.empty() && std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; });
+    };
+    const char* jobs = getenv("JOBS");
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg(argv[i]);
+        if (arg == "-j") {
+            jobs = (i + 1 < argc && digits(argv[i + 1])) ? argv[++i] : "0";
+        }
+        else if (arg.starts_with("-j") && digits(arg.substr(2))) {
+            jobs = argv[i] + 2;
+        }
+        else if (arg == "--jobs") {
+            jobs = (i + 1 < argc) ? argv[++i] : "";
+        }
+        else if (arg.starts_with("--jobs=")) {
+            jobs = argv[i] + 7;
+        }
+    }
+    if (!jobs) {
+        return 1;
+    }
+
+    // More workers than a few per hardware thread only costs memory
+    const uint32_t hardware = std::max(std::thread::hardware_concurrency(), 1u);
+    std::string_view text(jobs);
+    uint64_t count = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), count);
+    if (error != std::errc() || end != text.data() + text.size()) {
+        throw std::invalid_argument("JOBS must be a number of workers, 0 for one per hardware thread, not '"
+                                    + std::string(text) + "'");
+    }
+    if (count == 0) {
+        return hardware;
+    }
+    return static_cast<uint32_t>(std::min<uint64_t>(count, 4ull * hardware));
+}
+
+// Result of running one proof together with the failures it reported. An
+// exception escaping the proof is kept in error.
+struct ProofOutcome
+{
+    ProofResult result;
+    std::vector<ProofFailure> failures;
+    std::exception_ptr error;
+};
+
+inline ProofOutcome execute_proof(const ProofEntry& proof)
+{
+    ProofOutcome outcome{{proof.suite_name, proof.proof_name, proof.type, false, 0, 0, 0}, {}, {}};
+
+    // Setting up the fixture isn't measured, but an exception from it ends
+    // the proof like one from its body
+    std::unique_ptr<BaseFixture> fixture;
+    try {
+        fixture = proof.make_fixture(proof.suite_name, proof.proof_name);
+    }
+    catch (...) {
+        outcome.error = std::current_exception();
+        return outcome;
+    }
+
+    PerfCounters perf;
+    auto rss_before = max_rss_kb();
+    auto cpu_before = thread_cpu_time_ns();
+    auto wall_before = std::chrono::steady_clock::now();
+    auto allocations_before = allocation_counters.counts;
+    perf.start();
+
+    try {
+        proof.utest_wrapper(fixture.get());
+    }
+    catch (...) {
+        outcome.error = std::current_exception();
+    }
+
+    auto allocations_after = allocation_counters.counts;
+    outcome.result.perf_counters = perf.stop();
+    outcome.result.allocations = allocations_after.allocations - allocations_before.allocations;
+    outcome.result.allocated_bytes = allocations_after.bytes - allocations_before.bytes;
+    auto wall = std::chrono::steady_clock::now() - wall_before;
+    outcome.result.cpu_ns = thread_cpu_time_ns() - cpu_before;
+    outcome.result.max_rss_delta_kb = max_rss_kb() - rss_before;
+    outcome.result.wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count();
+
+    outcome.failures = fixture->utest_take_failures();
+    outcome.result.passed = outcome.failures.empty() && !outcome.error;
+    if (proof.release_fixture) {
+        auto failures = proof.release_fixture(std::move(fixture), outcome.result.passed);
+        if (!failures.empty()) {
+            outcome.failures.insert(outcome.failures.end(), std::make_move_iterator(failures.begin()),
+                                    std::make_move_iterator(failures.end()));
+            outcome.result.passed = false;
+        }
+    }
+    return outcome;
+}
+
+inline void register_failures(std::vector<ProofFailure> failures)
+{
+    if (!failures.empty()) {
+        std::lock_guard<std::mutex> lock(failures_mutex);
+        auto& all = proof_failures();
+        all.insert(all.end(), std::make_move_iterator(failures.begin()),
+                   std::make_move_iterator(failures.end()));
+    }
+}
+
+// Runs a proof in this process. An uncaught exception is passed on, after
+// the failures reported before it, and ends the run.
+inline void run_proof(const ProofEntry& proof)
+{
+    auto outcome = execute_proof(proof);
+    if (!outcome.error) {
+        register_proof_result(std::move(outcome.result), outcome.failures);
+    }
+    register_failures(std::move(outcome.failures));
+    if (outcome.error) {
+        std::rethrow_exception(outcome.error);
+    }
+}
+
+inline void encode_outcome(BinaryWriter& out,
+                           const ProofOutcome& outcome,
+                           const std::vector<BenchmarkResult>& benchmarks,
+                           const std::vector<StressResult>& stress)
+{
+    encode_result(out, outcome.result, outcome.failures);
+    out.u32(static_cast<uint32_t>(benchmarks.size()));
+    for (auto& benchmark : benchmarks) {
+        out.str(benchmark.suite_name);
+        out.str(benchmark.proof_name);
+        out.u64(benchmark.iterations);
+        out.u32(static_cast<uint32_t>(benchmark.samples.size()));
+        for (auto sample : benchmark.samples) {
+            out.f64(sample);
+        }
+        out.f64(benchmark.min_ns);
+        out.f64(benchmark.median_ns);
+        out.f64(benchmark.p99_ns);
+        out.u32(static_cast<uint32_t>(benchmark.perf_per_op.size()));
+        for (auto& [name, per_op] : benchmark.perf_per_op) {
+            out.str(name);
+            out.f64(per_op);
+        }
+    }
+    out.u32(static_cast<uint32_t>(stress.size()));
+    for (auto& result : stress) {
+        out.str(result.suite_name);
+        out.str(result.proof_name);
+        out.u32(static_cast<uint32_t>(result.iterations.size()));
+        for (size_t i = 0; i < result.iterations.size(); ++i) {
+            out.u64(result.iterations[i]);
+            out.i64(result.wall_ns[i]);
+        }
+    }
+}
+
+inline bool decode_outcome(BinaryReader& in,
+                           ProofOutcome& outcome,
+                           std::vector<BenchmarkResult>& benchmarks,
+                           std::vector<StressResult>& stress)
+{
+    decode_result(in, outcome.result, outcome.failures);
+    for (auto n = in.u32(); n > 0 && in.ok(); --n) {
+        BenchmarkResult benchmark;
+        benchmark.suite_name = in.str();
+        benchmark.proof_name = in.str();
+        benchmark.iterations = in.u64();
+        for (auto samples = in.u32(); samples > 0 && in.ok(); --samples) {
+            benchmark.samples.push_back(in.f64());
+        }
+        benchmark.min_ns = in.f64();
+        benchmark.median_ns = in.f64();
+        benchmark.p99_ns = in.f64();
+        for (auto counters = in.u32(); counters > 0 && in.ok(); --counters) {
+            auto name = in.str();
+            benchmark.perf_per_op.emplace_back(std::move(name), in.f64());
+        }
+        benchmarks.push_back(std::move(benchmark));
+    }
+    for (auto n = in.u32(); n > 0 && in.ok(); --n) {
+        StressResult result;
+        result.suite_name = in.str();
+        result.proof_name = in.str();
+        for (auto threads = in.u32(); threads > 0 && in.ok(); --threads) {
+            result.iterations.push_back(in.u64());
+            result.wall_ns.push_back(in.i64());
+        }
+        stress.push_back(std::move(result));
+    }
+    return in.ok();
+}
+
+// Name filter for SUITE/PROOF. The specification is a comma separated list
+// of patterns, where a leading '-' turns a pattern into an exclusion. A name
+// matches when it matches any inclusion (or there are none) and no
+// exclusion. Every pattern matches anywhere in the name: plain text is a
+// substring search, '*' and '?' make it a glob and only patterns using other
+// regex syntax are compiled into a std::regex.
+class NameFilter
+{
+public:
+    NameFilter() = default;
+
+    explicit NameFilter(std::string_view spec)
+    {
+        for (auto text : split(spec)) {
+            bool exclude = text.starts_with('-');
+            if (exclude) {
+                text.remove_prefix(1);
+            }
+            if (text.empty()) {
+                continue;
+            }
+            (exclude ? excludes_ : includes_).push_back(compile(text));
+        }
+    }
+
+    bool matches(std::string_view name) const
+    {
+        auto match = [name](const Pattern& p) { return p.matches(name); };
+        return (includes_.empty() || std::any_of(includes_.begin(), includes_.end(), match))
+               && std::none_of(excludes_.begin(), excludes_.end(), match);
+    }
+
+private:
+    struct Pattern
+    {
+        enum class Kind { substring, glob, regex };
+
+        Kind kind;
+        std::string text;
+        // Literal segments between the '*'s of a glob
+        std::vector<std::string> segments;
+        std::optional<std::regex> re;
+
+        bool matches(std::string_view name) const
+        {
+            switch (kind) {
+            case Kind::substring:
+                return find(name, text, 0) != std::string_view::npos;
+            case Kind::glob: {
+                size_t pos = 0;
+                for (const auto& segment : segments) {
+                    pos = find(name, segment, pos);
+                    if (pos == std::string_view::npos) {
+                        return false;
+                    }
+                    pos += segment.size();
+                }
+                return true;
+            }
+            case Kind::regex:
+                return std::regex_search(name.begin(), name.end(), *re);
+            }
+            return false;
+        }
+    };
+
+    // Finds needle in haystack starting at pos, where '?' in a glob segment
+    // matches any character. Segments without '?' go through memmem.
+    static size_t find(std::string_view haystack, std::string_view needle, size_t pos)
+    {
+        if (pos > haystack.size() || needle.size() > haystack.size() - pos) {
+            return std::string_view::npos;
+        }
+        if (needle.find('?') == std::string_view::npos) {
+#if defined(__GLIBC__)
+            auto found = static_cast<const char*>(
+                memmem(haystack.data() + pos, haystack.size() - pos, needle.data(), needle.size()));
+            return found ? static_cast<size_t>(found - haystack.data()) : std::string_view::npos;
+#else
+            return haystack.find(needle, pos);
+#endif
+        }
+        for (size_t i = pos; i + needle.size() <= haystack.size(); ++i) {
+            size_t j = 0;
+            while (j < needle.size() && (needle[j] == '?' || needle[j] == haystack[i + j])) {
+                ++j;
+            }
+            if (j == needle.size()) {
+                return i;
+            }
+        }
+        return std::string_view::npos;
+    }
+
+    // Splits on commas outside of regex brackets so that e.g. "a{1,3}" stays
+    // one pattern.
+    static std::vector<std::string_view> split(std::string_view spec)
+    {
+        std::vector<std::string_view> parts;
+        int32_t depth = 0;
+        size_t start = 0;
+        for (size_t i = 0; i < spec.size(); ++i) {
+            char c = spec[i];
+            if (c == '\\') {
+                ++i;
+            }
+            else if (c == '(' || c == '[' || c == '{') {
+                ++depth;
+            }
+            else if ((c == ')' || c == ']' || c == '}') && depth > 0) {
+                --depth;
+            }
+            else if (c == ',' && depth == 0) {
+                parts.push_back(spec.substr(start, i - start));
+                start = i + 1;
+            }
+        }
+        parts.push_back(spec.substr(start));
+        return parts;
+    }
+
+    static Pattern compile(std::string_view text)
+    {
+        if (text.find_first_of("^$.+()[]{}|\\") != std::string_view::npos) {
+            return {Pattern::Kind::regex, std::string(text), {},
+                    std::regex(std::string(text), std::regex::optimize)};
+        }
+        if (text.find_first_of("*?") == std::string_view::npos) {
+            return {Pattern::Kind::substring, std::string(text), {}, {}};
+        }
+        Pattern pattern{Pattern::Kind::glob, std::string(text), {}, {}};
+        size_t start = 0;
+        while (start <= text.size()) {
+            auto star = std::min(text.find('*', start), text.size());
+            if (star > start) {
+                pattern.segments.emplace_back(text.substr(start, star - start));
+            }
+            start = star + 1;
+        }
+        return pattern;
+    }
+
+    std::vector<Pattern> includes_;
+    std::vector<Pattern> excludes_;
+};
+
+inline NameFilter env_name_filter(const char* name)
+{
+    const char* spec = getenv(name);
+    return spec ? NameFilter(spec) : NameFilter();
+}
+
+// One object of a results file
+struct ResultRecord
+{
+    // Values as raw text, with strings unquoted
+    std::unordered_map<std::string, std::string> fields;
+    // The object as it appeared in the file
+    std::string json;
+
+    std::string& operator[](const std::string& key)
+    {
+        return fields[key];
+    }
+
+    bool contains(const std::string& key) const
+    {
+        return fields.contains(key);
+    }
+};
+
+// Reads the flat objects of a file written by write_results_file. It is
+// lenient on purpose so that JSON Lines and files truncated by a crashed
+// run can be read as well: parsing stops at the first malformed object.
+inline std::vector<ResultRecord> read_results_file(const std::filesystem::path& path)
+{
+    std::ifstream f(path);
+    std::string text((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+    std::vector<ResultRecord> records;
+    size_t i = 0;
+    auto skip_ws = [&] {
+        while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i]))) {
+            ++i;
+        }
+    };
+    auto parse_string = [&](std::string& out) {
+        if (i >= text.size() || text[i] != '"') {
+            return false;
+        }
+        for (++i; i < text.size() && text[i] != '"'; ++i) {
+            if (text[i] == '\\' && i + 1 < text.size()) {
+                switch (text[++i]) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'u':
+                    out += static_cast<char>(std::strtoul(text.substr(i + 1, 4).c_str(), nullptr, 16));
+                    i += 4;
+                    break;
+                default: out += text[i]; break;
+                }
+            }
+            else {
+                out += text[i];
+            }
+        }
+        return i++ < text.size();
+    };
+
+    while ((i = text.find('{', i)) != std::string::npos) {
+        auto start = i++;
+        ResultRecord record;
+        bool complete = false;
+        for (;;) {
+            skip_ws();
+            if (i < text.size() && text[i] == '}') {
+                ++i;
+                complete = true;
+                break;
+            }
+            std::string key;
+            if (!parse_string(key)) {
+                break;
+            }
+            skip_ws();
+            if (i >= text.size() || text[i++] != ':') {
+                break;
+            }
+            skip_ws();
+            std::string value;
+            if (i < text.size() && text[i] == '"') {
+                if (!parse_string(value)) {
+                    break;
+                }
+            }
+            else {
+                auto end = (i < text.size() && text[i] == '[') ? text.find(']', i) + 1
+                                                               : text.find_first_of(",}", i);
+                if (end == std::string::npos || end == 0) {
+                    break;
+                }
+                value = text.substr(i, end - i);
+                while (!value.empty() && std::isspace(static_cast<unsigned char>(value.back()))) {
+                    value.pop_back();
+                }
+                i = end;
+            }
+            record.fields[key] = std::move(value);
+            skip_ws();
+            if (i < text.size() && text[i] == ',') {
+                ++i;
+            }
+        }
+        if (!complete) {
+            break;
+        }
+        record.json = text.substr(start, i - start);
+        records.push_back(std::move(record));
+    }
+    return records;
+}
+
+// Splits a "suite::proof" name as written to results files
+inline std::pair<std::string, std::string> split_proof_name(const std::string& name)
+{
+    auto separator = name.find("::");
+    return {name.substr(0, separator), separator == std::string::npos ? "" : name.substr(separator + 2)};
+}
+
+// A proof result read back from a results file, without its failures
+inline ProofResult proof_result_from_record(ResultRecord& record)
+{
+    auto [suite_name, proof_name] = split_proof_name(record["name"]);
+    ProofResult result{
+        std::move(suite_name),
+        std::move(proof_name),
+        record.contains("type") ? record["type"] : "unittest",
+        record["passed"] == "true",
+        std::strtoll(record["wall_ns"].c_str(), nullptr, 10),
+        std::strtoll(record["cpu_ns"].c_str(), nullptr, 10),
+        std::strtoll(record["max_rss_delta_kb"].c_str(), nullptr, 10)
+    };
+    result.allocations = std::strtoull(record["allocations"].c_str(), nullptr, 10);
+    result.allocated_bytes = std::strtoull(record["allocated_bytes"].c_str(), nullptr, 10);
+    for (auto& [key, value] : record.fields) {
+        if (key.starts_with("perf_")) {
+            result.perf_counters.emplace_back(key.substr(5), std::strtoull(value.c_str(), nullptr, 10));
+        }
+    }
+    std::sort(result.perf_counters.begin(), result.perf_counters.end());
+    return result;
+}
+
+// A benchmark read back from a results file, with its samples
+inline BenchmarkResult benchmark_from_record(ResultRecord& record)
+{
+    BenchmarkResult benchmark;
+    std::tie(benchmark.suite_name, benchmark.proof_name) = split_proof_name(record["name"]);
+    benchmark.iterations = std::strtoull(record["iterations"].c_str(), nullptr, 10);
+    benchmark.min_ns = std::strtod(record["min_ns"].c_str(), nullptr);
+    benchmark.median_ns = std::strtod(record["median_ns"].c_str(), nullptr);
+    benchmark.p99_ns = std::strtod(record["p99_ns"].c_str(), nullptr);
+    const char* p = record["samples"].c_str() + 1;
+    for (;;) {
+        char* end;
+        auto value = std::strtod(p, &end);
+        if (end == p) {
+            break;
+        }
+        benchmark.samples.push_back(value);
+        p = end + (*end == ',' ? 1 : 0);
+    }
+    for (auto& [key, value] : record.fields) {
+        if (key.starts_with("perf_") && key.ends_with("_per_op")) {
+            benchmark.perf_per_op.emplace_back(key.substr(5, key.size() - 12), std::strtod(value.c_str(), nullptr));
+        }
+    }
+    std::sort(benchmark.perf_per_op.begin(), benchmark.perf_per_op.end());
+    return benchmark;
+}
+
+// The benchmarks in a results file, with their samples
+inline std::vector<BenchmarkResult> read_benchmarks(const std::filesystem::path& path)
+{
+    std::vector<BenchmarkResult> benchmarks;
+    for (auto& record : read_results_file(path)) {
+        if (record.contains("samples") && record.contains("name")) {
+            benchmarks.push_back(benchmark_from_record(record));
+        }
+    }
+    return benchmarks;
+}
+
+// Read once before any proof runs, so BASELINE_FILE can name the results
+// file of the previous run
+inline const std::unordered_map<std::string, BenchmarkResult>& baselines()
+{
+    static const auto by_name = [] {
+        std::unordered_map<std::string, BenchmarkResult> read;
+        if (const char* path = getenv("BASELINE_FILE")) {
+            for (auto& benchmark : read_benchmarks(path)) {
+                auto key = benchmark.suite_name + "::" + benchmark.proof_name;
+                read[key] = std::move(benchmark);
+            }
+        }
+        return read;
+    }();
+    return by_name;
+}
+
+// Wall time in ns of every proof recorded in a results file, by
+// "suite::proof" name.
+using ProofHistory = std::unordered_map<std::string, int64_t>;
+
+inline ProofHistory read_proof_history(const std::filesystem::path& path)
+{
+    ProofHistory history;
+    for (auto& record : read_results_file(path)) {
+        if (record.contains("name") && record.contains("wall_ns")) {
+            history[record["name"]] += std::strtoll(record["wall_ns"].c_str(), nullptr, 10);
+        }
+    }
+    return history;
+}
+
+inline ProofHistory env_proof_history()
+{
+    const char* history_file = getenv("HISTORY_FILE");
+    return history_file ? read_proof_history(history_file) : ProofHistory();
+}
+
+// What RERUN does with the proofs that failed in the previous run
+enum class RerunMode
+{
+    all,
+    failed,
+    failed_first,
+};
+
+inline RerunMode env_rerun_mode()
+{
+    const char* rerun = getenv("RERUN");
+    if (!rerun) {
+        return RerunMode::all;
+    }
+    std::string_view mode(rerun);
+    if (mode == "failed") {
+        return RerunMode::failed;
+    }
+    if (mode == "failed-first") {
+        return RerunMode::failed_first;
+    }
+    throw std::invalid_argument("RERUN must be failed or failed-first, not '" + std::string(mode) + "'");
+}
+
+// The failed proofs in a results file, with their wall time
+inline ProofHistory read_failed_proofs(const std::filesystem::path& path)
+{
+    ProofHistory failed;
+    for (auto& record : read_results_file(path)) {
+        if (record.contains("name") && record.contains("passed") && record["passed"] == "false") {
+            failed[record["name"]] = std::strtoll(record["wall_ns"].c_str(), nullptr, 10);
+        }
+    }
+    return failed;
+}
+
+// The proofs that failed in the previous run, from the JSON files in
+// RESULTS_FILE. Read once, before the results of this run replace them.
+inline const ProofHistory& previous_failures()
+{
+    static const ProofHistory failed = [] {
+        ProofHistory found;
+        for (auto& path : results_file_paths()) {
+            auto extension = path.extension();
+            if (extension != ".xml" && extension != ".bin" && std::filesystem::exists(path)) {
+                found.merge(read_failed_proofs(path));
+            }
+        }
+        return found;
+    }();
+    return failed;
+}
+
+// Applies a RERUN mode, keeping only the proofs that failed or moving them
+// to the front, in their order. Every proof runs when none of them failed.
+inline std::vector<const ProofEntry*> select_rerun(std::vector<const ProofEntry*> proofs,
+                                                   RerunMode mode,
+                                                   const ProofHistory& failed)
+{
+    if (mode == RerunMode::all || failed.empty()) {
+        return proofs;
+    }
+    auto rest = std::stable_partition(proofs.begin(), proofs.end(), [&](auto proof) {
+        return failed.contains(proof->suite_name + "::" + proof->proof_name);
+    });
+    if (mode == RerunMode::failed && rest != proofs.begin()) {
+        proofs.erase(rest, proofs.end());
+    }
+    return proofs;
+}
+
+// Splits proofs into the given number of bins. Given a history, proofs are
+// ordered longest first and each is put into the bin with the least
+// predicted work so far (LPT), so a long proof does not end up as the tail
+// of a run. Proofs missing from the history are assumed to take the average
+// recorded time. Without history proofs are dealt round robin in
+// declaration order.
+inline std::vector<std::vector<const ProofEntry*>> partition_longest_first(
+    const std::vector<const ProofEntry*>& proofs,
+    const ProofHistory& history,
+    uint32_t bin_count)
+{
+    std::vector<std::vector<const ProofEntry*>> bins(std::max<uint32_t>(bin_count, 1));
+    if (history.empty()) {
+        for (size_t i = 0; i < proofs.size(); ++i) {
+            bins[i % bins.size()].push_back(proofs[i]);
+        }
+        return bins;
+    }
+
+    int64_t total = 0;
+    for (auto& [name, wall_ns] : history) {
+        total += wall_ns;
+    }
+    const int64_t average = total / static_cast<int64_t>(history.size());
+
+    std::vector<std::pair<int64_t, const ProofEntry*>> estimated;
+    for (auto proof : proofs) {
+        auto it = history.find(proof->suite_name + "::" + proof->proof_name);
+        estimated.emplace_back(it != history.end() ? it->second : average, proof);
+    }
+    std::stable_sort(estimated.begin(), estimated.end(),
+                     [](auto& a, auto& b) { return a.first > b.first; });
+
+    std::vector<int64_t> load(bins.size(), 0);
+    for (auto& [duration, proof] : estimated) {
+        auto bin = std::min_element(load.begin(), load.end()) - load.begin();
+        load[bin] += duration;
+        bins[bin].push_back(proof);
+    }
+    return bins;
+}
+
+// FNV-1a, used where a hash has to be the same across builds and machines
+inline uint64_t stable_hash(std::string_view text)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : text) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Seed for shuffling the order proofs run in: SHUFFLE_SEED, or a new one
+// for every run with SHUFFLE=1. Nothing when not shuffling.
+inline std::optional<uint64_t> env_shuffle_seed()
+{
+    if (const char* seed = getenv("SHUFFLE_SEED")) {
+        return std::strtoull(seed, nullptr, 10);
+    }
+    if (const char* shuffle = getenv("SHUFFLE"); shuffle && std::string_view(shuffle) != "0") {
+        return stable_hash(std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+    }
+    return std::nullopt;
+}
+
+// Shuffles the order of the suites and of the proofs within each suite,
+// keeping the proofs of a suite together. The generator and the shuffle
+// are spelled out here rather than taken from <random> and <algorithm>,
+// whose results differ between standard libraries, so that a seed gives
+// the same order everywhere.
+inline std::vector<const ProofEntry*> shuffle_proofs(const std::vector<const ProofEntry*>& proofs, uint64_t seed)
+{
+    // splitmix64
+    auto next = [&seed] {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    };
+    auto shuffle = [&](auto& items) {
+        for (size_t i = items.size(); i > 1; --i) {
+            std::swap(items[i - 1], items[next() % i]);
+        }
+    };
+
+    std::vector<std::vector<const ProofEntry*>> suites;
+    for (auto proof : proofs) {
+        if (suites.empty() || suites.back().front()->suite_name != proof->suite_name) {
+            suites.emplace_back();
+        }
+        suites.back().push_back(proof);
+    }
+    shuffle(suites);
+
+    std::vector<const ProofEntry*> shuffled;
+    shuffled.reserve(proofs.size());
+    for (auto& suite : suites) {
+        shuffle(suite);
+        shuffled.insert(shuffled.end(), suite.begin(), suite.end());
+    }
+    return shuffled;
+}
+
+// Picks this shard's proofs, keeping their order. Every shard computes the
+// same partition as long as they see the same proofs and history: without
+// history a proof belongs to the shard its name hashes to, with history the
+// proofs are split longest first by recorded wall time, in name order.
+inline std::vector<const ProofEntry*> select_shard(const std::vector<const ProofEntry*>& proofs,
+                                                   ShardSpec shard,
+                                                   const ProofHistory& history)
+{
+    if (shard.count <= 1) {
+        return proofs;
+    }
+
+    std::vector<const ProofEntry*> selected;
+    if (history.empty()) {
+        for (auto proof : proofs) {
+            if (stable_hash(proof->suite_name + "::" + proof->proof_name) % shard.count == shard.index) {
+                selected.push_back(proof);
+            }
+        }
+        return selected;
+    }
+
+    auto by_name = proofs;
+    std::sort(by_name.begin(), by_name.end(), [](auto a, auto b) {
+        return std::tie(a->suite_name, a->proof_name) < std::tie(b->suite_name, b->proof_name);
+    });
+    auto bins = partition_longest_first(by_name, history, shard.count);
+    std::unordered_set<const ProofEntry*> own(bins[shard.index].begin(), bins[shard.index].end());
+    for (auto proof : proofs) {
+        if (own.contains(proof)) {
+            selected.push_back(proof);
+        }
+    }
+    return selected;
+}
+
+inline void schedule_proofs(WorkStealingPool<const ProofEntry*>& pool,
+                            const std::vector<const ProofEntry*>& proofs,
+                            const ProofHistory& history)
+{
+    auto bins = partition_longest_first(proofs, history, pool.size());
+    for (uint32_t worker = 0; worker < bins.size(); ++worker) {
+        for (auto proof : bins[worker]) {
+            pool.push(worker, proof);
+        }
+    }
+}
+
+// Default per-proof timeout from PROOF_TIMEOUT in ms, 0 meaning none
+inline int64_t env_proof_timeout_ms()
+{
+    const char* timeout = getenv("PROOF_TIMEOUT");
+    return timeout ? std::strtoll(timeout, nullptr, 10) : 0;
+}
+
+inline int64_t proof_timeout_ms(const ProofEntry& proof, int64_t default_timeout_ms)
+{
+    return proof.timeout_ms > 0 ? proof.timeout_ms : default_timeout_ms;
+}
+
+// Ends an in-process run when a proof exceeds its timeout. Every thread
+// running proofs owns a slot that it sets around each proof; a watchdog
+// thread checks the slots and, when one has overrun, reports what was
+// running, records the proof as failed, writes the results and exits with
+// utest_timeout_exit_code.
+class Watchdog
+{
+public:
+    Watchdog(uint32_t slots, int64_t default_timeout_ms) :
+        slots_(slots),
+        default_timeout_ms_(default_timeout_ms),
+        thread_([this] { watch(); })
+    { }
+
+    ~Watchdog()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopped_ = true;
+        }
+        condition_.notify_all();
+        thread_.join();
+    }
+
+    void start(uint32_t slot, const ProofEntry* proof)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slots_[slot] = Slot{proof, std::chrono::steady_clock::now()};
+    }
+
+    void finish(uint32_t slot)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slots_[slot].proof = nullptr;
+    }
+
+private:
+    struct Slot
+    {
+        const ProofEntry* proof = nullptr;
+        std::chrono::steady_clock::time_point started;
+    };
+
+    void watch()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!condition_.wait_for(lock, std::chrono::milliseconds(20), [this] { return stopped_; })) {
+            auto now = std::chrono::steady_clock::now();
+            for (auto& slot : slots_) {
+                if (!slot.proof) {
+                    continue;
+                }
+                auto timeout = std::chrono::milliseconds(proof_timeout_ms(*slot.proof, default_timeout_ms_));
+                if (timeout.count() > 0 && now - slot.started > timeout) {
+                    expire(slot, timeout, now);
+                }
+            }
+        }
+    }
+
+    [[noreturn]] void expire(const Slot& expired,
+                             std::chrono::milliseconds timeout,
+                             std::chrono::steady_clock::time_point now)
+    {
+        auto& proof = *expired.proof;
+        console().flush();
+        std::cout << std::endl << "TIMEOUT: '" << proof.suite_name << "::" << proof.proof_name
+                  << "' did not finish within " << timeout.count() << " ms" << std::endl;
+        for (auto& slot : slots_) {
+            if (slot.proof && &slot != &expired) {
+                std::cout << " - Also running: '" << slot.proof->suite_name << "::" << slot.proof->proof_name
+                          << "' for " << std::chrono::duration_cast<std::chrono::milliseconds>(now - slot.started).count()
+                          << " ms" << std::endl;
+            }
+        }
+
+        current_proof = proof.suite_name + "::" + proof.proof_name;
+        std::vector<ProofFailure> failures{ProofFailure{
+            proof.suite_name, proof.proof_name, std::string(proof.filename), proof.line_no, "timeout",
+            "still running after " + std::to_string(timeout.count()) + " ms", "finished", "proof"
+        }};
+        register_proof_result(ProofResult{
+            proof.suite_name, proof.proof_name, proof.type, false,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - expired.started).count(), 0, 0
+        }, failures);
+        register_failures(std::move(failures));
+
+        // Keep proofs that are still running from touching the results
+        // while they are written
+        std::scoped_lock results_lock(failures_mutex, proof_results_mutex);
+        try {
+            report_result();
+            write_results_file();
+        }
+        catch (...) {
+            std::cout << std::endl << "INTERNAL FAILURE" << std::endl;
+        }
+        std::cout.flush();
+        std::_Exit(utest_timeout_exit_code);
+    }
+
+    std::vector<Slot> slots_;
+    int64_t default_timeout_ms_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stopped_ = false;
+    std::thread thread_;
+};
+
+// Holds a watchdog slot for a proof until it goes out of scope, so that a
+// proof that throws doesn't leave a slot behind to expire. Does nothing
+// without a watchdog.
+class WatchdogSlot
+{
+public:
+    WatchdogSlot(std::optional<Watchdog>& watchdog, uint32_t slot, const ProofEntry* proof) :
+        watchdog_(watchdog ? &*watchdog : nullptr),
+        slot_(slot)
+    {
+        if (watchdog_) {
+            watchdog_->start(slot_, proof);
+        }
+    }
+
+    ~WatchdogSlot()
+    {
+        if (watchdog_) {
+            watchdog_->finish(slot_);
+        }
+    }
+
+    WatchdogSlot(const WatchdogSlot&) = delete;
+    WatchdogSlot& operator=(const WatchdogSlot&) = delete;
+
+private:
+    Watchdog* watchdog_;
+    uint32_t slot_;
+};
+
+#if defined(UTEST_POSIX)
+inline std::string signal_name(int signal)
+{
+    switch (signal) {
+    case SIGABRT: return "SIGABRT";
+    case SIGBUS: return "SIGBUS";
+    case SIGFPE: return "SIGFPE";
+    case SIGILL: return "SIGILL";
+    case SIGKILL: return "SIGKILL";
+    case SIGSEGV: return "SIGSEGV";
+    case SIGTERM: return "SIGTERM";
+    case SIGTRAP: return "SIGTRAP";
+    default: return "signal " + std::to_string(signal);
+    }
+}
+
+// Runs proofs in a pool of forked worker processes that are reused from one
+// proof to the next. Each worker reads proof indices from a pipe and writes
+// back an encoded ProofOutcome per proof. A worker that dies takes only its
+// current proof with it: that proof is recorded as failed with the signal
+// or exit status, and the worker is replaced.
+class IsolatedRunner
+{
+public:
+    IsolatedRunner(const std::vector<const ProofEntry*>& proofs,
+                   uint32_t workers,
+                   int64_t default_timeout_ms) :
+        proofs_(proofs),
+        workers_(std::min<size_t>(std::max<uint32_t>(workers, 1), proofs.size())),
+        default_timeout_ms_(default_timeout_ms)
+    { }
+
+    void run()
+    {
+        // Workers start from a copy of this process, don't let them inherit
+        // buffered output, and don't die writing to a worker that crashed.
+        std::cout.flush();
+        auto previous_sigpipe = signal(SIGPIPE, SIG_IGN);
+
+        for (auto& worker : workers_) {
+            spawn(worker);
+        }
+
+        // Once FAIL_FAST stops the run, only wait for the proofs running
+        size_t next = 0;
+        while (done_ < (run_stopped ? next : proofs_.size())) {
+            for (auto& worker : workers_) {
+                if (!worker.proof && next < proofs_.size() && !run_stopped) {
+                    dispatch(worker, next++);
+                }
+            }
+
+            std::vector<pollfd> fds;
+            int poll_timeout_ms = -1;
+            auto now = std::chrono::steady_clock::now();
+            for (auto& worker : workers_) {
+                if (!worker.proof) {
+                    continue;
+                }
+                fds.push_back(pollfd{worker.from_worker, POLLIN, 0});
+                if (auto timeout = timeout_of(worker); timeout.count() > 0) {
+                    auto left = std::chrono::ceil<std::chrono::milliseconds>(worker.started + timeout - now);
+                    auto left_ms = static_cast<int>(std::max<int64_t>(left.count(), 0));
+                    poll_timeout_ms = poll_timeout_ms < 0 ? left_ms : std::min(poll_timeout_ms, left_ms);
+                }
             }
-        }
-        catch (...) {
-            // Wrong exception was thrown
-            try {
-                throw;
+            if (poll(fds.data(), fds.size(), poll_timeout_ms) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "poll");
             }
-            catch (const std::exception& ex) {
-                // Let's catch std::exception explicitly
-                // (because it's a common base class for exceptions)
-                // to produce better errors using typeid on 'ex'
-                if (report_failure) {
-                    add_failure(filename,
-                                line_no,
-                                "try {...}",
-                                typeid(ex).name(),
-                                exception_str,
-                                "exception");
+            for (auto& fd : fds) {
+                if (fd.revents == 0) {
+                    continue;
+                }
+                auto& worker = *std::find_if(workers_.begin(), workers_.end(),
+                                             [&](auto& w) { return w.from_worker == fd.fd; });
+                if (!receive(worker)) {
+                    crashed(worker);
+                    spawn(worker);
                 }
-                return false;
             }
-            catch (...) {
-                if (report_failure) {
-                    add_failure(filename,
-                                line_no,
-                                "try {...}",
-                                "<unknown>",
-                                exception_str,
-                                "exception");
+
+            now = std::chrono::steady_clock::now();
+            for (auto& worker : workers_) {
+                auto timeout = timeout_of(worker);
+                if (worker.proof && timeout.count() > 0 && now - worker.started >= timeout) {
+                    kill(worker.pid, SIGKILL);
+                    worker.timed_out = true;
+                    crashed(worker);
+                    spawn(worker);
                 }
-                return false;
             }
         }
+
+        for (auto& worker : workers_) {
+            stop(worker);
+        }
+        signal(SIGPIPE, previous_sigpipe);
+        proofs_not_run += proofs_.size() - next;
     }
 
-    void sync_point(const std::string& name, int32_t count = 2)
+private:
+    struct Worker
     {
-        auto key = name + std::to_string(count);
-        {
-            std::lock_guard<std::mutex> lock(barriers_mutex_);
-            barriers_.try_emplace(key, count);
+        pid_t pid = -1;
+        int to_worker = -1;
+        int from_worker = -1;
+        std::optional<size_t> proof;
+        std::chrono::steady_clock::time_point started;
+        bool timed_out = false;
+        std::string received;
+    };
+
+    std::chrono::milliseconds timeout_of(const Worker& worker) const
+    {
+        if (!worker.proof) {
+            return std::chrono::milliseconds(0);
         }
-        barriers_.at(key).arrive_and_wait();
+        return std::chrono::milliseconds(proof_timeout_ms(*proofs_[*worker.proof], default_timeout_ms_));
     }
 
-    using time_point = std::chrono::time_point<std::chrono::system_clock>;
-
-    void mark_time(const std::string& name)
+    void spawn(Worker& worker)
     {
-        std::lock_guard<std::mutex> lock(time_points_mutex_);
-        time_points_[name] = time_point::clock::now();
+        int to_worker[2];
+        int from_worker[2];
+        if (pipe(to_worker) != 0) {
+            throw std::system_error(errno, std::generic_category(), "pipe");
+        }
+        if (pipe(from_worker) != 0) {
+            close(to_worker[0]);
+            close(to_worker[1]);
+            throw std::system_error(errno, std::generic_category(), "pipe");
+        }
+
+        auto pid = fork();
+        if (pid < 0) {
+            throw std::system_error(errno, std::generic_category(), "fork");
+        }
+        if (pid == 0) {
+            close(to_worker[1]);
+            close(from_worker[0]);
+            // Other workers must see EOF when the runner closes their pipes
+            for (auto& other : workers_) {
+                if (other.pid > 0) {
+                    close(other.to_worker);
+                    close(other.from_worker);
+                }
+            }
+            worker_main(to_worker[0], from_worker[1]);
+        }
+
+        close(to_worker[0]);
+        close(from_worker[1]);
+        worker.pid = pid;
+        worker.to_worker = to_worker[1];
+        worker.from_worker = from_worker[0];
+        worker.proof.reset();
+        worker.timed_out = false;
+        worker.received.clear();
     }
 
-    int64_t time_since_mark(const std::string& name)
+    // The forked worker has a copy of this runner and of utest_main, which
+    // it must never return into: anything thrown past the proofs ends it,
+    // and the runner reports a crash of the proof it was running
+    [[noreturn]] void worker_main(int from_runner, int to_runner)
     {
-        std::lock_guard<std::mutex> lock(time_points_mutex_);
-        if (time_points_.contains(name)) {
-            return std::chrono::duration_cast<std::chrono::milliseconds>(
-                time_point::clock::now() - time_points_[name]
-            ).count();
+        try {
+            serve(from_runner, to_runner);
         }
-        else {
-            return std::chrono::milliseconds::max().count();
+        catch (...) {
+            std::cout.flush();
+            _exit(1);
         }
+        _exit(0);
     }
 
-    int64_t time_between_marks(const std::string& mark1,
-                               const std::string& mark2)
+    void serve(int from_runner, int to_runner)
     {
-        if (!time_points_.contains(mark1)
-            || !time_points_.contains(mark2)) {
-            return std::chrono::milliseconds::max().count();
+        // Only send back what this worker measured itself, and leave the
+        // runner's output to the runner
+        benchmark_results().clear();
+        stress_results().clear();
+        clear_crash_flushers();
+        if (std::cout.rdbuf() == &stdout_buffer()) {
+            add_crash_flusher(flush_stdout);
         }
-        else {
-            return std::chrono::duration_cast<std::chrono::milliseconds>(
-                time_points_[mark2] - time_points_[mark1]
-            ).count();
+
+        uint32_t index;
+        while (read_all(from_runner, reinterpret_cast<char*>(&index), sizeof(index))) {
+            auto& proof = *proofs_[index];
+            auto outcome = execute_proof(proof);
+            if (outcome.error) {
+                outcome.failures.push_back(ProofFailure{
+                    outcome.result.suite_name,
+                    outcome.result.proof_name,
+                    std::string(proof.filename),
+                    proof.line_no,
+                    "uncaught exception",
+                    exception_message(outcome.error),
+                    "no exception",
+                    "proof"
+                });
+            }
+            std::vector<BenchmarkResult> benchmarks;
+            benchmarks.swap(benchmark_results());
+            std::vector<StressResult> stress;
+            stress.swap(stress_results());
+
+            BinaryWriter payload;
+            encode_outcome(payload, outcome, benchmarks, stress);
+            BinaryWriter frame;
+            frame.u32(static_cast<uint32_t>(payload.data().size()));
+            std::cout.flush();
+            if (!write_all(to_runner, frame.data()) || !write_all(to_runner, payload.data())) {
+                break;
+            }
+        }
+        // The runner has closed its end, and reads the failures of tearing
+        // down the pooled fixtures until this one is closed too
+        auto failures = fixture_pool().tear_down();
+        BinaryWriter payload;
+        payload.u32(static_cast<uint32_t>(failures.size()));
+        for (auto& failure : failures) {
+            encode_failure(payload, failure);
+        }
+        BinaryWriter frame;
+        frame.u32(static_cast<uint32_t>(payload.data().size()));
+        std::cout.flush();
+        if (write_all(to_runner, frame.data())) {
+            write_all(to_runner, payload.data());
         }
     }
 
+    void dispatch(Worker& worker, size_t index)
+    {
+        console().proof(proofs_[index]->suite_name + "::" + proofs_[index]->proof_name);
+        auto value = static_cast<uint32_t>(index);
+        worker.proof = index;
+        worker.started = std::chrono::steady_clock::now();
+        // A failed write means the worker is gone, which the following read
+        // reports as a crash
+        write_all(worker.to_worker, std::string_view(reinterpret_cast<const char*>(&value), sizeof(value)));
+    }
 
-private:
-    template <typename A>
-    std::string to_string(const A& a)
+    // Reads what the worker has sent, returns false once it has gone away
+    bool receive(Worker& worker)
+    {
+        char buffer[65536];
+        auto n = read(worker.from_worker, buffer, sizeof(buffer));
+        if (n < 0) {
+            return errno == EINTR;
+        }
+        if (n == 0) {
+            return false;
+        }
+        worker.received.append(buffer, static_cast<size_t>(n));
+
+        while (worker.received.size() >= 4) {
+            BinaryReader header(worker.received);
+            auto size = header.u32();
+            if (worker.received.size() < 4 + size) {
+                break;
+            }
+            BinaryReader in(std::string_view(worker.received).substr(4, size));
+            ProofOutcome outcome;
+            std::vector<BenchmarkResult> benchmarks;
+            std::vector<StressResult> stress;
+            if (!decode_outcome(in, outcome, benchmarks, stress)) {
+                return false;
+            }
+            worker.received.erase(0, 4 + size);
+
+            register_proof_result(std::move(outcome.result), outcome.failures);
+            register_failures(std::move(outcome.failures));
+            if (!benchmarks.empty()) {
+                std::lock_guard<std::mutex> lock(benchmark_results_mutex);
+                auto& all = benchmark_results();
+                all.insert(all.end(), benchmarks.begin(), benchmarks.end());
+            }
+            if (!stress.empty()) {
+                std::lock_guard<std::mutex> lock(stress_results_mutex);
+                auto& all = stress_results();
+                all.insert(all.end(), stress.begin(), stress.end());
+            }
+            worker.proof.reset();
+            done_ += 1;
+        }
+        return true;
+    }
+
+    void crashed(Worker& worker)
     {
-        std::stringstream ss;
-        ss << a;
-        return ss.str();
+        int status = 0;
+        close(worker.to_worker);
+        close(worker.from_worker);
+        waitpid(worker.pid, &status, 0);
+        worker.pid = -1;
+        if (!worker.proof) {
+            return;
+        }
+
+        auto& proof = *proofs_[*worker.proof];
+        auto wall = std::chrono::steady_clock::now() - worker.started;
+        std::vector<ProofFailure> failures;
+        if (worker.timed_out) {
+            auto timeout = std::to_string(timeout_of(worker).count());
+            console().flush();
+            std::cout << "TIMEOUT: '" << proof.suite_name << "::" << proof.proof_name
+                      << "' did not finish within " << timeout << " ms, its worker was killed" << std::endl;
+            failures.push_back(ProofFailure{
+                proof.suite_name, proof.proof_name, std::string(proof.filename), proof.line_no, "timeout",
+                "still running after " + timeout + " ms", "finished", "proof"
+            });
+        }
+        else {
+            std::string reason = WIFSIGNALED(status) ? "killed by " + signal_name(WTERMSIG(status))
+                                                     : "exited with status " + std::to_string(WEXITSTATUS(status));
+            failures.push_back(ProofFailure{
+                proof.suite_name, proof.proof_name, std::string(proof.filename), proof.line_no,
+                "crashed", reason, "completed", "proof"
+            });
+        }
+        register_proof_result(ProofResult{
+            proof.suite_name,
+            proof.proof_name,
+            proof.type,
+            false,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count(),
+            0,
+            0
+        }, failures);
+        register_failures(std::move(failures));
+        worker.proof.reset();
+        done_ += 1;
     }
 
-    std::string to_string(const std::u8string& a)
+    // Ends an idle worker and registers the failures of tearing down its
+    // pooled fixtures, which it sends as it exits
+    void stop(Worker& worker)
     {
-        std::stringstream ss;
-        ss << std::bit_cast<const char*>(a.c_str());
-        return ss.str();
+        close(worker.to_worker);
+        auto& received = worker.received;
+        char buffer[65536];
+        for (;;) {
+            auto n = read(worker.from_worker, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            received.append(buffer, static_cast<size_t>(n));
+        }
+        BinaryReader header(received);
+        auto size = header.u32();
+        if (header.ok() && received.size() >= 4 + size) {
+            BinaryReader in(std::string_view(received).substr(4, size));
+            std::vector<ProofFailure> failures;
+            for (auto n = in.u32(); n > 0 && in.ok(); --n) {
+                failures.push_back(decode_failure(in));
+            }
+            if (in.ok()) {
+                register_failures(std::move(failures));
+            }
+        }
+        received.clear();
+        close(worker.from_worker);
+        int status = 0;
+        waitpid(worker.pid, &status, 0);
+        worker.pid = -1;
     }
 
-    std::string to_string(const char8_t* a)
+    static bool write_all(int fd, std::string_view data)
     {
-        std::stringstream ss;
-        ss << std::bit_cast<const char*>(a);
-        return ss.str();
+        while (!data.empty()) {
+            auto n = write(fd, data.data(), data.size());
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            data.remove_prefix(static_cast<size_t>(n));
+        }
+        return true;
     }
 
-    std::unordered_map<std::string, Barrier> barriers_;
-    std::mutex barriers_mutex_;
+    static bool read_all(int fd, char* data, size_t size)
+    {
+        while (size > 0) {
+            auto n = read(fd, data, size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
 
-    std::unordered_map<std::string, time_point> time_points_;
-    std::mutex time_points_mutex_;
+    const std::vector<const ProofEntry*>& proofs_;
+    std::vector<Worker> workers_;
+    int64_t default_timeout_ms_;
+    size_t done_ = 0;
 };
+#endif
 
-class Fixture : public BaseFixture
+// Adds the STATIC_ENSURE proofs that pass the filters to the registry,
+// suite by suite after the proofs of suites defined before them.
+inline void populate_static_proofs(const NameFilter& suite_filter, const NameFilter& proof_filter)
 {
-public:
-    virtual void set_up() {}
-    virtual void tear_down() {}
-    std::function<void()> utest_proof;
-};
-
-class EmptyFixture : public Fixture { };
-
-#define MODEL(suite_name) SUITE_GEN_UNIQUE(suite_name, __LINE__)
-#define SUITE(suite_name) SUITE_GEN_UNIQUE(suite_name, __LINE__)
-#define SUITE_GEN_UNIQUE(x, y) SUITE_INTERNAL(x, y)
-#define SUITE_INTERNAL(suite_name, unique_line) \
-    static void utest_suite ## unique_line(); \
-    namespace {bool reg ## unique_line = register_suite_function(suite_name, utest_suite ## unique_line);} \
-    static void utest_suite ## unique_line()
-
-#define ENSURE(what) ENSURE_GIVEN(what, EmptyFixture)
-#define ENSURE_GIVEN(what, given) \
-    utest_suite_proofs()[utest_active_suite_name()].push_back(std::unique_ptr<BaseFixture>{static_cast<BaseFixture*>(new given{})}); \
-    utest_suite_proofs()[utest_active_suite_name()].back()->utest_suite_name = utest_active_suite_name(); \
-    utest_suite_proofs()[utest_active_suite_name()].back()->utest_proof_name = what; \
-    utest_suite_proofs()[utest_active_suite_name()].back()->utest_wrapper = [&](BaseFixture* a) { \
-        given* utest_fixture_ = static_cast<given*>(a); \
-        utest_fixture_->set_up(); \
-        utest_fixture_->utest_proof(); \
-        utest_fixture_->tear_down(); \
-    }; \
-    static_cast<Fixture*>(utest_suite_proofs()[utest_active_suite_name()].back().get())->utest_proof = (std::function<void()>)[=, &fixture = *static_cast<given*>(utest_suite_proofs()[utest_active_suite_name()].back().get())]() \
+    std::vector<const StaticProof*> selected;
+    for (auto node = static_proofs; node; node = node->next) {
+        if (suite_filter.matches(node->proof.suite_name) && proof_filter.matches(node->proof.proof_name)) {
+            selected.push_back(&node->proof);
+        }
+    }
+    if (selected.empty()) {
+        return;
+    }
 
-#define ASSERT(pred) fixture.utest_assert((pred) ? true : false, __FILE__, __LINE__, #pred)
-// Note: actual and expected might be expressions that need to be evaluated
-// and can thus not be passed to utest_assert_eq directly.
-#define ASSERT_EQ(actual, expected) ([&]{auto&& _utest_a=actual;auto&& _utest_e=expected; return fixture.utest_assert_eq(_utest_a, _utest_e, __FILE__,  __LINE__, #actual, #expected);}())
-#define ASSERT_THROW(statement, exception) fixture.utest_assert_throw<exception>([&](){statement}, __FILE__, __LINE__, #exception)
-#define ASSERT_NO_THROW(statement) fixture.utest_assert_no_throw([&](){statement}, __FILE__, __LINE__)
+    auto& proofs = utest_proofs();
+    std::reverse(selected.begin(), selected.end());
+    for (auto proof : selected) {
+        ProofEntry entry{proof->suite_name, proof->proof_name, proof->make_fixture, proof->run};
+        entry.filename = proof->filename;
+        entry.line_no = proof->line_no;
+        entry.release_fixture = proof->release_fixture;
+        auto suite = std::find_if(utest_suites().begin(), utest_suites().end(), [&](auto& s) {
+            return s.name == proof->suite_name;
+        });
+        entry.serial = suite != utest_suites().end() && suite->serial;
+        proofs.push_back(std::move(entry));
+    }
 
-#define TRY_ASSERT(pred, timeoutms) ([&]{ \
-    for (int32_t ta__t = 0; ta__t < (timeoutms/25); ++ta__t) { \
-        if (fixture.utest_assert(pred ? true : false, __FILE__, __LINE__, #pred, false)) { \
-            return true; \
-        } \
-        std::this_thread::sleep_for(std::chrono::milliseconds(25)); \
-    } \
-    return fixture.utest_assert(pred ? true : false, __FILE__, __LINE__, #pred);}())
-
-#define TRY_ASSERT_EQ(actual, expected, timeoutms) ([&]{ \
-    for (int32_t ta__t = 0; ta__t < (timeoutms/25); ++ta__t) { \
-        auto&& _utest_a=actual; \
-        auto&& _utest_e=expected; \
-        if (fixture.utest_assert_eq(_utest_a, _utest_e, __FILE__,  __LINE__, #actual, #expected, false)) { \
-            return true; \
-        } \
-        std::this_thread::sleep_for(std::chrono::milliseconds(25)); \
-    } \
-    auto&& _utest_a=actual; \
-    auto&& _utest_e=expected; \
-    return fixture.utest_assert_eq(_utest_a, _utest_e, __FILE__,  __LINE__, #actual, #expected);}())
-
-#define TRY_ASSERT_THROW(statement, exception, timeoutms) ([&]{ \
-    for (int32_t ta__t = 0; ta__t < (timeoutms/25); ++ta__t) { \
-        if (fixture.utest_assert_throw<exception>([&](){statement}, __FILE__, __LINE__, #exception, false)) { \
-            return true; \
-        } \
-        std::this_thread::sleep_for(std::chrono::milliseconds(25)); \
-    } \
-    return fixture.utest_assert_throw<exception>([&](){statement}, __FILE__, __LINE__, #exception);}())
-
-#define TRY_ASSERT_NO_THROW(statement, timeoutms) ([&]{ \
-    for (int32_t ta__t = 0; ta__t < (timeoutms/25); ++ta__t) { \
-        if (fixture.utest_assert_no_throw([&](){statement}, __FILE__, __LINE__, false)) { \
-            return true; \
-        } \
-        std::this_thread::sleep_for(std::chrono::milliseconds(25)); \
-    } \
-    return fixture.utest_assert_no_throw([&](){statement}, __FILE__, __LINE__);}())
-
-
-inline std::unordered_map<std::string, std::vector<std::function<void()>>>& utest_suites()
-{
-    static std::unordered_map<std::string, std::vector<std::function<void()>>> _s;
-    return _s;
+    // Keep the proofs of a suite together, in the order suites first appear.
+    // The keys are copies since sorting moves the names around.
+    std::unordered_map<std::string, size_t> suite_order;
+    for (auto& proof : proofs) {
+        suite_order.try_emplace(proof.suite_name, suite_order.size());
+    }
+    std::stable_sort(proofs.begin(), proofs.end(), [&](auto& a, auto& b) {
+        return suite_order[a.suite_name] < suite_order[b.suite_name];
+    });
 }
 
-inline std::unordered_map<std::string, std::vector<std::unique_ptr<BaseFixture>>>& utest_suite_proofs()
+// The proofs to run: those passing SUITE and PROOF, in this shard
+inline std::vector<const ProofEntry*> select_proofs(const ProofHistory& history)
 {
-    static std::unordered_map<std::string, std::vector<std::unique_ptr<BaseFixture>>> _p;
-    return _p;
-}
+    const NameFilter suite_filter = env_name_filter("SUITE");
+    const NameFilter proof_filter = env_name_filter("PROOF");
 
-inline std::string& utest_active_suite_name()
-{
-    static std::string _n;
-    return _n;
+    std::vector<const ProofEntry*> selected;
+    const std::string* suite = nullptr;
+    bool suite_selected = false;
+    for (auto& proof : utest_proofs()) {
+        if (!suite || *suite != proof.suite_name) {
+            suite = &proof.suite_name;
+            suite_selected = suite_filter.matches(*suite);
+        }
+        if (suite_selected && proof_filter.matches(proof.proof_name)) {
+            selected.push_back(&proof);
+        }
+    }
+    auto proofs = select_shard(selected, env_shard(), history);
+    auto mode = env_rerun_mode();
+    return mode == RerunMode::all ? proofs : select_rerun(std::move(proofs), mode, previous_failures());
 }
 
-inline std::vector<ProofFailure>& proof_failures()
+inline void run_proof_phase(const std::vector<const ProofEntry*>& selected,
+                            uint32_t jobs,
+                            const ProofHistory& history,
+                            int64_t default_timeout_ms)
 {
-    static std::vector<ProofFailure> _f;
-    return _f;
-}
+    if (run_stopped) {
+        proofs_not_run += selected.size();
+        return;
+    }
 
-inline std::vector<std::string> passed_proofs;
+    std::vector<const ProofEntry*> parallel_proofs;
+    std::vector<const ProofEntry*> serial_proofs;
+#if defined(UTEST_POSIX)
+    if (getenv("ISOLATE")) {
+        // Serial proofs get a single worker process of their own first
+        for (auto proof : selected) {
+            bool serial = jobs <= 1 || proof->serial;
+            (serial ? serial_proofs : parallel_proofs).push_back(proof);
+        }
+        IsolatedRunner(serial_proofs, 1, default_timeout_ms).run();
+        IsolatedRunner(partition_longest_first(parallel_proofs, history, 1)[0], jobs, default_timeout_ms).run();
+        return;
+    }
+#endif
 
-// Used for error reporting uncaught exceptions
-inline std::string current_proof;
+    // Slot 0 is this thread, slot 1 + i pool worker i
+    std::optional<Watchdog> watchdog;
+    bool timeouts = default_timeout_ms > 0 || std::any_of(selected.begin(), selected.end(), [](auto proof) {
+        return proof->timeout_ms > 0;
+    });
+    if (timeouts) {
+        watchdog.emplace(jobs + 1, default_timeout_ms);
+    }
 
-inline bool register_suite_function(const char* name, std::function<void()> suite_function)
-{
-    utest_suites()[name].push_back(suite_function);
-    return true;
-}
+    const std::string* header_suite = nullptr;
+    for (auto proof : selected) {
+        if (jobs > 1 && !proof->serial) {
+            parallel_proofs.push_back(proof);
+            continue;
+        }
+        if (skip_stopped_proof()) {
+            continue;
+        }
+        if (!header_suite || *header_suite != proof->suite_name) {
+            console().suite(proof->suite_name);
+            header_suite = &proof->suite_name;
+        }
+        console().proof(proof->proof_name);
 
-inline size_t suite_count()
-{
-    return utest_suites().size();
-}
+        current_proof = proof->suite_name + "::" + proof->proof_name;
+        WatchdogSlot slot(watchdog, 0, proof);
+        run_proof(*proof);
+    }
 
-inline void register_passed_proof(const std::string& suite_name,
-                                  const std::string& proof_name)
-{
-    passed_proofs.emplace_back(suite_name + "::" + proof_name);
-}
+    if (parallel_proofs.empty()) {
+        return;
+    }
 
-inline void populate_suite_proofs()
-{
-    if (suite_count() > 0) {
-        for (auto& [suite_name, suite_functions] : utest_suites()) {
-            utest_active_suite_name() = suite_name;
+    WorkStealingPool<const ProofEntry*> pool(jobs);
+    schedule_proofs(pool, parallel_proofs, history);
 
-            for (auto& suite_function : suite_functions) {
-                suite_function();
+    // Proofs of serial suites have already run on this thread, the rest are
+    // spread across the pool. The first uncaught exception stops the pool
+    // and is rethrown here so utest_main can report it as before.
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    pool.run([&](uint32_t worker, const ProofEntry* proof) {
+        if (skip_stopped_proof()) {
+            return;
+        }
+        auto name = proof->suite_name + "::" + proof->proof_name;
+        console().proof(name);
+        try {
+            WatchdogSlot slot(watchdog, worker + 1, proof);
+            run_proof(*proof);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+                current_proof = name;
             }
+            pool.stop();
         }
+    });
+    if (error) {
+        std::rethrow_exception(error);
     }
 }
 
-inline void run_suite_proofs()
+// Runs the selected proofs. With RERUN=failed-first the proofs that failed
+// in the previous run finish before the others start.
+inline void run_suite_proofs(uint32_t jobs = 1)
 {
-    using namespace std::literals;
-
-    const char* suite_filter = getenv("SUITE");
-    const char* proof_filter = getenv("PROOF");
-    bool quiet = getenv("Q") != nullptr;
+    const ProofHistory history = env_proof_history();
+    const int64_t default_timeout_ms = env_proof_timeout_ms();
 
-    std::regex suite_re(".*");
-    std::regex proof_re(".*");
-    if (suite_filter) {
-        suite_re = ".*"s + suite_filter + ".*";
+    auto selected = select_proofs(history);
+    std::vector<std::vector<const ProofEntry*>> phases{selected};
+    if (auto mode = env_rerun_mode(); mode != RerunMode::all) {
+        auto& failed = previous_failures();
+        for (auto& proof : utest_proofs()) {
+            auto name = proof.suite_name + "::" + proof.proof_name;
+            if (auto it = failed.find(name); it != failed.end()) {
+                carried_failures().emplace(name, ProofResult{
+                    proof.suite_name, proof.proof_name, proof.type, false, it->second, 0, 0
+                });
+            }
+        }
+        auto rest = std::find_if_not(selected.begin(), selected.end(), [&](auto proof) {
+            return failed.contains(proof->suite_name + "::" + proof->proof_name);
+        });
+        auto rerun = static_cast<size_t>(rest - selected.begin());
+        if (rerun == 0) {
+            std::cout << "No failed proofs to rerun, running all " << selected.size() << "\n";
+        }
+        else if (mode == RerunMode::failed) {
+            std::cout << "Rerunning " << rerun << " failed proofs\n";
+        }
+        else {
+            std::cout << "Running " << rerun << " failed proofs first\n";
+            phases = {{selected.begin(), rest}, {rest, selected.end()}};
+        }
+    }
+    if (auto seed = env_shuffle_seed()) {
+        std::cout << "Shuffling with SHUFFLE_SEED=" << *seed << "\n";
+        for (auto& phase : phases) {
+            phase = shuffle_proofs(phase, *seed);
+        }
     }
-    if (proof_filter) {
-        proof_re = ".*"s + proof_filter + ".*";
+    console().start(selected.size());
+
+    for (auto& phase : phases) {
+        run_proof_phase(phase, jobs, history, default_timeout_ms);
     }
+}
 
-    for (auto& [suite_name, proofs] : utest_suite_proofs()) {
-        if (!std::regex_match(suite_name, suite_re)) {
-            continue;
-        }
-        if (!quiet) {
-            std::cout << "== " << suite_name << " ==" << std::endl;
+inline void report_benchmarks()
+{
+    if (benchmark_results().empty()) {
+        return;
+    }
+    std::cout << "Benchmarks:\n";
+    auto flags = std::cout.flags();
+    std::cout << std::fixed << std::setprecision(1);
+    for (auto& result : benchmark_results()) {
+        std::cout << " - " << result.suite_name << "::" << result.proof_name
+                  << ": min " << result.min_ns << " ns/op"
+                  << ", median " << result.median_ns << " ns/op"
+                  << ", p99 " << result.p99_ns << " ns/op"
+                  << " (" << result.samples.size() << " x " << result.iterations
+                  << " iterations)";
+        for (auto& [name, per_op] : result.perf_per_op) {
+            std::cout << ", " << per_op << " " << name << "/op";
         }
-        for (auto& fixture : proofs) {
-            auto proof_name = fixture->utest_proof_name;
+        std::cout << "\n";
+    }
+    std::cout.flags(flags);
+}
 
-            if (!std::regex_match(proof_name, proof_re)) {
-                continue;
-            }
-            if (!quiet) {
-                std::cout << " * " << proof_name << std::endl;
-            }
+// Per-thread throughput of the ENSURE_CONCURRENTLY proofs
+inline void report_stress_results()
+{
+    if (stress_results().empty()) {
+        return;
+    }
+    std::cout << "Concurrency:\n";
+    auto flags = std::cout.flags();
+    std::cout << std::fixed << std::setprecision(2);
+    for (auto& result : stress_results()) {
+        std::vector<double> rates;
+        for (size_t i = 0; i < result.iterations.size(); ++i) {
+            rates.push_back(result.wall_ns[i] > 0 ? result.iterations[i] * 1e3 / result.wall_ns[i] : 0.0);
+        }
+        auto [min, max] = std::minmax_element(rates.begin(), rates.end());
+        auto total = std::accumulate(rates.begin(), rates.end(), 0.0);
+        std::cout << " - " << result.suite_name << "::" << result.proof_name
+                  << ": " << rates.size() << " threads, " << total << " M iterations/s"
+                  << " (per thread min " << (min != rates.end() ? *min : 0.0)
+                  << ", max " << (max != rates.end() ? *max : 0.0) << ")\n";
+    }
+    std::cout.flags(flags);
+}
 
-            auto pre_failed_proofs_size = proof_failures().size();
-            current_proof = std::string(suite_name) + "::" + proof_name;
+// Prints the SLOWEST (default 5) proofs by wall time
+inline void report_slowest_proofs()
+{
+    if (slowest_proofs().empty() || getenv("Q")) {
+        return;
+    }
 
-            fixture->utest_wrapper(fixture.get());
-            if (pre_failed_proofs_size == proof_failures().size()) {
-                register_passed_proof(suite_name, fixture->utest_proof_name);
-            }
+    std::cout << "Slowest proofs:\n";
+    auto flags = std::cout.flags();
+    std::cout << std::fixed << std::setprecision(1);
+    for (auto& result : slowest_proofs()) {
+        std::cout << " - " << result.wall_ns / 1e6 << " ms"
+                  << " (cpu " << result.cpu_ns / 1e6 << " ms";
+        for (auto& [name, count] : result.perf_counters) {
+            std::cout << ", " << count << " " << name;
         }
+        std::cout << ") " << result.suite_name << "::" << result.proof_name << "\n";
     }
+    std::cout.flags(flags);
 }
 
 inline void report_result()
 {
+    console().flush();
+    report_slowest_proofs();
+    report_benchmarks();
+    report_stress_results();
+    if (proofs_not_run > 0) {
+        std::cout << "Stopped at the first failure, " << proofs_not_run << " proofs not run\n";
+    }
     std::cout << "Result: " << (proof_failures().empty() ?
-                                "OK" : "FAILED") << std::endl;
+                                "OK" : "FAILED") << "\n";
 
     for (auto& failure : proof_failures()) {
         std::cout << " - " << failure.suite_name << " @ " << failure.filename
                   << ":" << failure.line_no << "\n"
-                  << "   \"" << failure.proof_name << "\": " << failure.test
-                  << " (expected '" << failure.actual_str << "' to be " << failure.expected
-                  << ", actual = " << failure.actual << ")" << std::endl;
+                  << "   \"" << failure.proof_name << "\": " << failure_message(failure) << "\n";
     }
+    std::cout.flush();
 }
 
 inline void report_exception(const std::string& msg = "")
 {
+    console().flush();
     std::cout << "Result: FAILED" << std::endl;
-    std::cout << " - Uncaught exception in '" + current_proof + "'";
+    std::cout << " - Uncaught exception";
+    // None before or after the proofs run, e.g. for a malformed setting
+    if (!current_proof.empty()) {
+        std::cout << " in '" + current_proof + "'";
+    }
     if (!msg.empty()) {
         std::cout << ": " << msg;
     }
     std::cout << std::endl;
 }
 
+// Finishes the results files that results have been streamed to, adding
+// the failures carried over by RERUN and the results of the benchmarks
 inline void write_results_file()
 {
-    const auto res_file = getenv("RESULTS_FILE");
-    if (!res_file) {
-        return;
+    for (auto& stream : results_streams()) {
+        std::cout << " - Writing results to: " << stream->path().string() << std::endl;
+        for (auto& [name, result] : carried_failures()) {
+            stream->append(result, {});
+        }
+        for (auto& benchmark : benchmark_results()) {
+            stream->append_benchmark(benchmark);
+        }
+        stream->close();
     }
+}
 
-    std::filesystem::path res_file_path(res_file);
-
-    std::cout << " - Writing results to: " << res_file_path.string() << std::endl;
+// With UPDATE_BASELINE set, writes the benchmarks of this run to
+// BASELINE_FILE, keeping the baselines of benchmarks that weren't run
+inline void update_baseline_file()
+{
+    const char* path = getenv("BASELINE_FILE");
+    if (!getenv("UPDATE_BASELINE") || !path) {
+        return;
+    }
+    auto benchmarks = benchmark_results();
+    std::unordered_set<std::string> measured;
+    for (auto& benchmark : benchmarks) {
+        measured.insert(benchmark.suite_name + "::" + benchmark.proof_name);
+    }
+    for (auto& [name, benchmark] : baselines()) {
+        if (!measured.contains(name)) {
+            benchmarks.push_back(benchmark);
+        }
+    }
+    // Sorted by name so that baselines diff well
+    std::sort(benchmarks.begin(), benchmarks.end(), [](auto& a, auto& b) {
+        return std::tie(a.suite_name, a.proof_name) < std::tie(b.suite_name, b.proof_name);
+    });
+    std::cout << " - Writing baseline to: " << path << std::endl;
+    ResultsStream stream(path, std::make_unique<JsonReporter>(false));
+    for (auto& benchmark : benchmarks) {
+        stream.append_benchmark(benchmark);
+    }
+    stream.close();
+}
 
-    std::ofstream f(res_file_path);
-    f << "[\n";
-    bool first = true;
-    for (auto proof : passed_proofs) {
-        if (!first) {
-            f << ",\n";
+// Prints the proofs a run would run without running them, for LIST=json as
+// a JSON array and otherwise a line per proof with the name and location
+// separated by a tab. Fixtures are never constructed.
+inline std::string list_proofs(const std::vector<const ProofEntry*>& proofs, bool json)
+{
+    std::string out = json ? "[" : "";
+    for (auto proof : proofs) {
+        if (json) {
+            out += out.size() > 1 ? ",\n  {\"suite\": " : "\n  {\"suite\": ";
+            append_json_string(out, proof->suite_name);
+            out += ", \"proof\": ";
+            append_json_string(out, proof->proof_name);
+            out += ", \"type\": ";
+            append_json_string(out, proof->type);
+            out += ", \"file\": ";
+            append_json_string(out, proof->filename);
+            out += ", \"line\": " + std::to_string(proof->line_no) + "}";
         }
         else {
-            first = false;
+            out += proof->suite_name + "::" + proof->proof_name + "\t";
+            out += proof->filename;
+            out += ":" + std::to_string(proof->line_no) + "\n";
         }
-        std::replace(proof.begin(), proof.end(), '"', '\'');
-        f << "  {\n";
-        f << "    \"type\": \"unittest\",\n";
-        f << "    \"name\": \"" << proof << "\",\n";
-        f << "    \"passed\": true\n";
-        f << "  }";
     }
-    for (auto& failure : proof_failures()) {
-        if (!first) {
-            f << ",\n";
+    if (json) {
+        out += proofs.empty() ? "]\n" : "\n]\n";
+    }
+    return out;
+}
+
+// Combines the comma separated JSON results files in MERGE_RESULTS, e.g. the
+// fragments written by the shards of a run, into every file of
+// RESULTS_FILE, each in the format its name asks for.
+inline bool merge_results_files(std::string_view fragments,
+                                const std::vector<std::filesystem::path>& outputs = results_file_paths())
+{
+    if (outputs.empty()) {
+        std::cout << " - MERGE_RESULTS needs RESULTS_FILE to be set" << std::endl;
+        return false;
+    }
+
+    std::vector<ResultRecord> records;
+    while (!fragments.empty()) {
+        auto comma = std::min(fragments.find(','), fragments.size());
+        std::filesystem::path fragment(fragments.substr(0, comma));
+        fragments.remove_prefix(std::min(comma + 1, fragments.size()));
+        if (!std::filesystem::exists(fragment)) {
+            std::cout << " - Missing results file: " << fragment.string() << std::endl;
+            return false;
         }
-        else {
-            first = false;
+        if (auto extension = fragment.extension(); extension == ".xml" || extension == ".bin") {
+            std::cout << " - Only JSON results files can be merged: " << fragment.string() << std::endl;
+            return false;
+        }
+        for (auto& record : read_results_file(fragment)) {
+            records.push_back(std::move(record));
+        }
+    }
+
+    // Keep the allocation counts of fragments from runs that tracked them
+    if (std::any_of(records.begin(), records.end(), [](auto& r) { return r.contains("allocations"); })) {
+        allocation_tracking = true;
+    }
+    for (auto& path : outputs) {
+        std::cout << " - Writing merged results to: " << path.string() << std::endl;
+        ResultsStream stream(path);
+        for (auto& record : records) {
+            if (record.contains("samples")) {
+                stream.append_benchmark(benchmark_from_record(record));
+            }
+            else if (record.contains("name")) {
+                stream.append(proof_result_from_record(record));
+            }
         }
-        f << "  {\n";
-        f << "    \"type\": \"unittest\",\n";
-        f << "    \"name\": \"" << failure.suite_name << "::" << failure.proof_name << "\",\n";
-        f << "    \"passed\": false\n";
-        f << "  }";
+        stream.close();
     }
-    f << "\n]\n";
+    return true;
 }
 
 inline int utest_main(int argc, char* argv[])
 {
-    populate_suite_proofs();
+    if (const char* fragments = getenv("MERGE_RESULTS")) {
+        // e.g. a malformed SHARD_INDEX in the names of the results files
+        try {
+            return merge_results_files(fragments) ? 0 : 1;
+        }
+        catch (const std::exception& ex) {
+            report_exception(ex.what());
+            return 1;
+        }
+        catch (...) {
+            report_exception();
+            return 1;
+        }
+    }
+    if (const char* status_file = getenv("GTEST_SHARD_STATUS_FILE")) {
+        // Tells a GTest-aware runner that sharding is supported
+        std::ofstream touch(status_file, std::ios::app);
+    }
+
+    if (!console().live()) {
+        // Batches console output, see ConsoleReporter
+        std::cout.flush();
+#if defined(UTEST_POSIX)
+        std::cout.rdbuf(&stdout_buffer());
+        add_crash_flusher(flush_stdout);
+#else
+        std::setvbuf(stdout, nullptr, _IOFBF, 64 * 1024);
+#endif
+    }
+
+    // From here on a malformed setting, e.g. a SUITE regex or SHARD_INDEX,
+    // is reported as an exception
     try {
-        run_suite_proofs();
+        case_batches = parse_case_batches(getenv("EACH_BATCHES"));
+        populate_suite_proofs();
+        populate_static_proofs(env_name_filter("SUITE"), env_name_filter("PROOF"));
+        if (const char* list = getenv("LIST")) {
+            auto out = list_proofs(select_proofs(env_proof_history()), std::string_view(list) == "json");
+            std::fwrite(out.data(), 1, out.size(), stdout);
+            return 0;
+        }
+        baselines();
+        run_suite_proofs(job_count(argc, argv));
+        // Pool workers have torn down their fixtures as they exited
+        fixture_pool().release();
         try {
             report_result();
             write_results_file();
+            update_baseline_file();
         }
         catch (...) {
             std::cout << std::endl << "INTERNAL FAILURE" << std::endl;
@@ -0,0 +1,90 @@
+// Replaces the global operator new and delete to count the allocations of
+// every thread in allocation_counters, for ASSERT_NO_ALLOC and the per-proof
+// allocation counts. Linking this file in turns the counting on.
+#include "utest.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+const bool registered = [] {
+    allocation_tracking = true;
+    return true;
+}();
+
+void count_allocation(std::size_t size)
+{
+    auto& counters = allocation_counters;
+    if (counters.paused == 0) {
+        counters.counts.allocations += 1;
+        counters.counts.bytes += size;
+    }
+}
+
+void count_deallocation(void* ptr)
+{
+    auto& counters = allocation_counters;
+    if (ptr && counters.paused == 0) {
+        counters.counts.deallocations += 1;
+    }
+}
+
+void* allocate(std::size_t size)
+{
+    count_allocation(size);
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void* allocate(std::size_t size, std::align_val_t alignment)
+{
+    count_allocation(size);
+    auto align = std::max(static_cast<std::size_t>(alignment), sizeof(void*));
+    // aligned_alloc wants a multiple of the alignment
+    return std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align);
+}
+
+template <typename... Alignment>
+void* allocate_or_throw(std::size_t size, Alignment... alignment)
+{
+    if (auto ptr = allocate(size, alignment...)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void deallocate(void* ptr)
+{
+    count_deallocation(ptr);
+    std::free(ptr);
+}
+
+}
+
+void* operator new(std::size_t size) { return allocate_or_throw(size); }
+void* operator new[](std::size_t size) { return allocate_or_throw(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocate_or_throw(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocate_or_throw(size, alignment); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocate(size, alignment);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocate(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { deallocate(ptr); }